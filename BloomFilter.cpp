@@ -0,0 +1,77 @@
+#include "BloomFilter.hpp"
+
+#include "read_chunk.hpp"
+#include "write_chunk.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+struct BloomHeader {
+	uint32_t log2_bits = 0;
+	uint32_t probes = 0;
+	uint64_t inserted = 0;
+};
+static_assert(sizeof(BloomHeader) == 16, "BloomHeader should be packed.");
+
+BloomFilter::BloomFilter(uint32_t log2_bits_, uint32_t probes_) : log2_bits(log2_bits_), probes(probes_) {
+	bits.resize(std::max< uint64_t >(1, (uint64_t(1) << log2_bits) / 64), 0);
+	//largest key count n with false positive rate (1 - e^(-probes * n / m))^probes below 1%:
+	double m = double(uint64_t(1) << log2_bits);
+	capacity = uint64_t(-m / probes * std::log(1.0 - std::pow(0.01, 1.0 / probes)));
+}
+
+//probe i looks at bit (h1 + i * h2) mod m (double hashing); h2 is odd, so probes don't repeat:
+void BloomFilter::insert(uint64_t key) {
+	if (inserted >= capacity) clear();
+	uint64_t mask = (uint64_t(1) << log2_bits) - 1;
+	uint64_t h2 = ((key >> 32) | (key << 32)) | 1;
+	for (uint32_t i = 0; i < probes; ++i) {
+		uint64_t b = (key + i * h2) & mask;
+		bits[b / 64] |= uint64_t(1) << (b % 64);
+	}
+	++inserted;
+}
+
+bool BloomFilter::contains(uint64_t key) const {
+	uint64_t mask = (uint64_t(1) << log2_bits) - 1;
+	uint64_t h2 = ((key >> 32) | (key << 32)) | 1;
+	for (uint32_t i = 0; i < probes; ++i) {
+		uint64_t b = (key + i * h2) & mask;
+		if (!(bits[b / 64] & (uint64_t(1) << (b % 64)))) return false;
+	}
+	return true;
+}
+
+void BloomFilter::clear() {
+	std::fill(bits.begin(), bits.end(), 0);
+	inserted = 0;
+}
+
+void BloomFilter::save(std::string const &filename) const {
+	BloomHeader header;
+	header.log2_bits = log2_bits;
+	header.probes = probes;
+	header.inserted = inserted;
+
+	std::ofstream out(filename, std::ios::binary);
+	write_chunk(out, "blm0", std::vector< BloomHeader >(1, header));
+	write_chunk(out, "bit0", bits);
+}
+
+bool BloomFilter::load(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) return false;
+
+	std::vector< BloomHeader > header;
+	read_chunk(in, "blm0", &header);
+	if (header.size() != 1 || header[0].log2_bits != log2_bits || header[0].probes != probes) return false;
+
+	std::vector< uint64_t > loaded;
+	read_chunk(in, "bit0", &loaded);
+	if (loaded.size() != bits.size()) return false;
+
+	bits.swap(loaded);
+	inserted = header[0].inserted;
+	return true;
+}
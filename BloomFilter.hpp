@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// The 'BloomFilter' struct remembers a set of 64-bit keys (which should
+// already be well-mixed hashes) in a fixed number of bits. contains() never
+// misses an inserted key, but may rarely report a key that wasn't inserted.
+// Once more keys are inserted than the filter can hold at about a 1% false
+// positive rate, it forgets everything and starts over, so memory stays fixed.
+
+struct BloomFilter {
+	BloomFilter(uint32_t log2_bits = 25, uint32_t probes = 7);
+
+	void insert(uint64_t key);
+	bool contains(uint64_t key) const;
+	void clear();
+
+	//save and load in the chunk format of read_chunk.hpp;
+	// load returns false (leaving the filter unchanged) if the file is missing or was saved with other parameters:
+	void save(std::string const &filename) const;
+	bool load(std::string const &filename);
+
+	uint32_t log2_bits;
+	uint32_t probes; //bits set per key
+	uint64_t capacity; //keys held before starting over
+	uint64_t inserted = 0;
+	std::vector< uint64_t > bits;
+};
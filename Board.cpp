@@ -0,0 +1,108 @@
+#include "Board.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+Board::Board(glm::uvec2 size_) : size(size_), cells(size_.x * size_.y, Empty), touched_rows(size_.y, 0), touched_columns(size_.x, 0) {
+}
+
+void Board::clear() {
+	std::fill(cells.begin(), cells.end(), Empty);
+}
+
+void Board::clear_touched() {
+	if (!touched) return;
+	std::fill(touched_rows.begin(), touched_rows.end(), 0);
+	std::fill(touched_columns.begin(), touched_columns.end(), 0);
+	touched = false;
+}
+
+uint32_t Board::count(Piece piece) const {
+	return uint32_t(std::count(cells.begin(), cells.end(), piece));
+}
+
+bool Board::is_win() const {
+	return count(Black) == 1 && count(White) == 1;
+}
+
+bool Board::apply(Move move) {
+	bool horizontal = (move == Left || move == Right || move == PowerLeft || move == PowerRight);
+	bool toward_start = (move == Left || move == Up || move == PowerLeft || move == PowerUp);
+	bool powerful = (move >= PowerLeft);
+
+	//rows are lines for horizontal moves, columns for vertical ones:
+	uint32_t lines = (horizontal ? size.y : size.x);
+	uint32_t length = (horizontal ? size.x : size.y);
+	uint32_t stride = (horizontal ? 1 : size.x);
+	std::vector< uint8_t > &touched_lines = (horizontal ? touched_rows : touched_columns);
+
+	bool changed = false;
+	for (uint32_t l = 0; l < lines; ++l) {
+		Piece *line = &cells[horizontal ? l * size.x : l];
+		bool line_changed = false;
+
+		if (powerful) { //remove pieces that match the previous piece in the line
+			Piece prev = Empty;
+			for (uint32_t i = 0; i < length; ++i) {
+				Piece &p = line[i * stride];
+				if (p == Empty) continue;
+				if (p == prev) {
+					p = Empty;
+					line_changed = true;
+				} else {
+					prev = p;
+				}
+			}
+		}
+
+		//slide: pack the remaining pieces against one end, keeping their order:
+		if (toward_start) {
+			uint32_t head = 0;
+			for (uint32_t i = 0; i < length; ++i) {
+				Piece &p = line[i * stride];
+				if (p == Empty) continue;
+				if (i != head) {
+					line[head * stride] = p;
+					p = Empty;
+					line_changed = true;
+				}
+				++head;
+			}
+		} else {
+			uint32_t head = length;
+			for (uint32_t i = length; i-- > 0; ) {
+				Piece &p = line[i * stride];
+				if (p == Empty) continue;
+				--head;
+				if (i != head) {
+					line[head * stride] = p;
+					p = Empty;
+					line_changed = true;
+				}
+			}
+		}
+
+		if (line_changed) {
+			touched_lines[l] = 1;
+			changed = true;
+		}
+	}
+	touched = touched || changed;
+	return changed;
+}
+
+uint64_t Board::pack() const {
+	assert(can_pack());
+	uint64_t code = 0;
+	for (uint32_t i = 0; i < cells.size(); ++i) {
+		code |= uint64_t(cells[i]) << (2 * i);
+	}
+	return code;
+}
+
+void Board::unpack(uint64_t code) {
+	assert(can_pack());
+	for (uint32_t i = 0; i < cells.size(); ++i) {
+		cells[i] = Piece((code >> (2 * i)) & 3);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// The 'Board' struct holds the pieces on the game grid and implements the
+// slide rules. It has no OpenGL state, so stage generators and offline tools
+// can use it without a window.
+
+struct Board {
+	enum Piece : uint8_t { Empty = 0, Black = 1, White = 2 };
+
+	//normal slides move every piece as far as possible in a direction;
+	//powerful slides first merge runs of same-colored pieces in each row (Left/Right) or column (Up/Down):
+	enum Move : uint8_t { Left, Right, Up, Down, PowerLeft, PowerRight, PowerUp, PowerDown };
+	static constexpr uint32_t MoveCount = 8;
+
+	Board(glm::uvec2 size = glm::uvec2(4,4));
+
+	glm::uvec2 size;
+	std::vector< Piece > cells; //row-major, row 0 is the top row on screen
+
+	Piece &at(uint32_t row, uint32_t column) { return cells[row * size.x + column]; }
+	Piece const &at(uint32_t row, uint32_t column) const { return cells[row * size.x + column]; }
+
+	void clear();
+	uint32_t count(Piece piece) const;
+
+	//a board is won when exactly one black and one white piece remain:
+	bool is_win() const;
+
+	//apply a move; returns true if any cell changed:
+	bool apply(Move move);
+
+	//------- change tracking -------
+	//apply() marks the rows (Left/Right) or columns (Up/Down) it changed, so that copies of the
+	// board (e.g. on the GPU) can update just those lines; whoever reads the marks clears them.
+	//(clear() and unpack() don't mark anything, since they replace the whole board.)
+	bool touched = false; //any line marked
+	std::vector< uint8_t > touched_rows; //size.y entries, nonzero if that row changed
+	std::vector< uint8_t > touched_columns; //size.x entries
+	void clear_touched();
+
+	//------- packed form -------
+	//Boards with at most MaxPackedCells cells can be packed into a 64-bit code,
+	// two bits per cell, cell (row,column) at bit 2*(row*size.x+column):
+	static constexpr uint32_t MaxPackedCells = 32;
+	bool can_pack() const { return size.x * size.y <= MaxPackedCells; }
+	uint64_t pack() const;
+	void unpack(uint64_t code);
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// 'CompactVertex' is the 16-byte mesh vertex stored in "dat1" chunks (see bake-meshes.cpp),
+// as an alternative to the 28-byte float Position/Normal/Color vertex of "dat0" chunks:
+//  Position : three half floats (plus one of padding), read as GL_HALF_FLOAT
+//  Normal   : signed 10-bit x,y,z packed as GL_INT_2_10_10_10_REV (normalized)
+//  Color    : unchanged, four unsigned bytes
+//Half floats keep 11 significant bits, which is plenty for meshes modelled around the origin
+// at about the size of a board cell.
+
+struct CompactVertex {
+	uint16_t Position[4];
+	uint32_t Normal;
+	glm::u8vec4 Color;
+
+	CompactVertex() = default;
+	CompactVertex(glm::vec3 const &position, glm::vec3 const &normal, glm::u8vec4 const &color) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			Position[i] = to_half(position[i]);
+		}
+		Position[3] = 0;
+		Normal = 0;
+		for (uint32_t i = 0; i < 3; ++i) {
+			int32_t c = int32_t(std::round(std::max(-1.0f, std::min(1.0f, normal[i])) * 511.0f));
+			Normal |= (uint32_t(c) & 0x3ff) << (10 * i);
+		}
+		Color = color;
+	}
+
+	glm::vec3 position() const {
+		return glm::vec3(from_half(Position[0]), from_half(Position[1]), from_half(Position[2]));
+	}
+	glm::vec3 normal() const {
+		glm::vec3 ret;
+		for (uint32_t i = 0; i < 3; ++i) {
+			int32_t c = int32_t((Normal >> (10 * i)) & 0x3ff);
+			if (c & 0x200) c -= 0x400; //sign-extend
+			ret[i] = std::max(-1.0f, float(c) / 511.0f);
+		}
+		return ret;
+	}
+
+	//IEEE half float conversion (round to nearest even; overflow goes to infinity):
+	static uint16_t to_half(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, 4);
+		uint16_t sign = uint16_t((x >> 16) & 0x8000);
+		uint32_t exponent = (x >> 23) & 0xff;
+		uint32_t mantissa = x & 0x7fffff;
+		if (exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0); //inf or nan
+		int32_t e = int32_t(exponent) - 127 + 15;
+		if (e >= 31) return sign | 0x7c00;
+		if (e <= 0) { //subnormal (or zero)
+			if (e < -10) return sign;
+			mantissa |= 0x800000;
+			uint32_t shift = uint32_t(14 - e);
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1U << shift) - 1);
+			uint32_t halfway = 1U << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+			return sign | uint16_t(half);
+		}
+		uint32_t half = (uint32_t(e) << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half; //(may carry into the exponent, which is correct)
+		return sign | uint16_t(half);
+	}
+	static float from_half(uint16_t h) {
+		uint32_t sign = uint32_t(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		uint32_t x;
+		if (exponent == 0) {
+			if (mantissa == 0) {
+				x = sign;
+			} else { //subnormal: renormalize
+				exponent = 127 - 15 + 1;
+				while (!(mantissa & 0x400)) {
+					mantissa <<= 1;
+					--exponent;
+				}
+				x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+		} else if (exponent == 0x1f) {
+			x = sign | 0x7f800000 | (mantissa << 13);
+		} else {
+			x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		}
+		float f;
+		std::memcpy(&f, &x, 4);
+		return f;
+	}
+};
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex should be packed.");
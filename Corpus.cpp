@@ -0,0 +1,159 @@
+#include "Corpus.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t Corpus::MaxMoves;
+
+Corpus::Corpus(std::string const &filename) {
+	{ //map the whole file read-only:
+		#if defined(_WIN32)
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			file = nullptr;
+			throw std::runtime_error("Failed to open corpus '" + filename + "'.");
+		}
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		mapping_size = size_t(file_size.QuadPart);
+		file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (file_mapping) mapping = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!mapping) {
+			if (file_mapping) CloseHandle(file_mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map corpus '" + filename + "'.");
+		}
+		#else
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("Failed to open corpus '" + filename + "'.");
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			throw std::runtime_error("Failed to stat corpus '" + filename + "'.");
+		}
+		mapping_size = size_t(st.st_size);
+		void *m = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); //the mapping keeps its own reference to the file
+		if (m == MAP_FAILED) {
+			throw std::runtime_error("Failed to map corpus '" + filename + "'.");
+		}
+		//stages are sampled at random, so don't bother reading ahead:
+		madvise(m, mapping_size, MADV_RANDOM);
+		mapping = m;
+		#endif
+	}
+
+	//walk the chunk headers, checking each against the file size:
+	char const *at = reinterpret_cast< char const * >(mapping);
+	char const *end = at + mapping_size;
+	auto chunk = [&](char const *magic, size_t *size) -> void const * {
+		struct ChunkHeader {
+			char magic[4];
+			uint32_t size;
+		};
+		static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+		ChunkHeader header;
+		if (size_t(end - at) < sizeof(header)) {
+			throw std::runtime_error("Corpus is truncated.");
+		}
+		std::memcpy(&header, at, sizeof(header));
+		if (std::memcmp(header.magic, magic, 4) != 0) {
+			throw std::runtime_error("Unexpected magic number in corpus chunk.");
+		}
+		at += sizeof(header);
+		if (size_t(end - at) < header.size || header.size % 8 != 0) {
+			throw std::runtime_error("Corpus chunk has a bad size.");
+		}
+		void const *data = at;
+		at += header.size;
+		*size = header.size;
+		return data;
+	};
+
+	try {
+		size_t size = 0;
+		void const *data = chunk("crp0", &size);
+		if (size != sizeof(Info)) throw std::runtime_error("Corpus info chunk has the wrong size.");
+		std::memcpy(&info, data, sizeof(Info));
+
+		if (info.max_moves > MaxMoves) throw std::runtime_error("Corpus has too many buckets.");
+
+		//(sizes are compared as entry counts, in 64 bits, so a bad header can't wrap them around)
+		offsets = reinterpret_cast< uint64_t const * >(chunk("off0", &size));
+		if (size / sizeof(uint64_t) != uint64_t(info.max_moves) + 2) throw std::runtime_error("Corpus offset table has the wrong size.");
+		for (uint32_t n = 0; n <= info.max_moves; ++n) {
+			if (offsets[n] > offsets[n+1]) throw std::runtime_error("Corpus offset table is not sorted.");
+		}
+
+		boards = reinterpret_cast< uint64_t const * >(chunk("brd0", &size));
+		if (offsets[0] != 0 || size / sizeof(uint64_t) != this->size()) throw std::runtime_error("Corpus board count doesn't match offset table.");
+
+		hashes = reinterpret_cast< uint64_t const * >(chunk("hsh0", &size));
+		if (size / sizeof(uint64_t) != this->size()) throw std::runtime_error("Corpus hash count doesn't match offset table.");
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+Corpus::~Corpus() {
+	unmap();
+}
+
+void Corpus::unmap() {
+	if (!mapping) return;
+	#if defined(_WIN32)
+	UnmapViewOfFile(mapping);
+	CloseHandle(file_mapping);
+	CloseHandle(file);
+	#else
+	munmap(const_cast< void * >(mapping), mapping_size);
+	#endif
+	mapping = nullptr;
+}
+
+uint64_t Corpus::count(uint32_t moves) const {
+	if (moves > info.max_moves) return 0;
+	return offsets[moves + 1] - offsets[moves];
+}
+
+bool Corpus::sample(uint32_t min_moves, uint32_t max_moves, uint64_t random, uint64_t *index, uint32_t *moves) const {
+	if (max_moves > info.max_moves) max_moves = info.max_moves;
+
+	//non-empty buckets in range, widening one step at a time in both directions if there are none:
+	uint32_t found = 0;
+	uint32_t lo = min_moves, hi = max_moves;
+	while (true) {
+		for (uint32_t n = lo; n <= hi; ++n) {
+			if (count(n) > 0) ++found;
+		}
+		if (found > 0) break;
+		if (lo == 0 && hi >= info.max_moves) return false;
+		if (lo > 0) --lo;
+		if (hi < info.max_moves) ++hi;
+	}
+
+	//top bits choose the bucket, the rest choose the stage within it:
+	uint32_t pick = uint32_t((random >> 40) % found);
+	for (uint32_t n = lo; n <= hi; ++n) {
+		if (count(n) == 0) continue;
+		if (pick-- == 0) {
+			*index = offsets[n] + (random & 0xffffffffffULL) % count(n);
+			*moves = n;
+			return true;
+		}
+	}
+	return false;
+}
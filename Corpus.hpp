@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// The 'Corpus' struct gives read-only access to a file of pre-rated stages,
+// grouped into buckets by optimal solution length (build-corpus.cpp writes
+// these files). The file is memory-mapped: opening it only reads the small
+// header chunks, and only the pages holding sampled stages are ever loaded.
+//
+// The file is a sequence of chunks in the style of read_chunk.hpp:
+//  "crp0" : one Info record
+//  "off0" : uint64_t bucket offsets; bucket n holds stages [off[n], off[n+1])
+//  "brd0" : uint64_t packed boards (see Board::pack), canonical under symmetry (see Solver::canonical)
+//  "hsh0" : uint64_t canonical hash of each board (see Solver::canonical_hash)
+// Every chunk size is a multiple of 8 bytes, so all arrays stay 8-byte aligned.
+
+struct Corpus {
+	//maps the corpus at 'filename'; throws on failure or if the file is malformed:
+	Corpus(std::string const &filename);
+	~Corpus();
+	Corpus(Corpus const &) = delete;
+	Corpus &operator=(Corpus const &) = delete;
+
+	struct Info {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t max_moves = 0; //buckets are numbered 0 .. max_moves
+		uint32_t reserved = 0;
+	};
+	static_assert(sizeof(Info) == 16, "Info should be packed.");
+	Info info;
+
+	//corpora with more buckets than this are rejected as malformed (build-corpus won't write them):
+	static constexpr uint32_t MaxMoves = 1024;
+
+	uint64_t const *offsets = nullptr; //info.max_moves + 2 entries
+	uint64_t const *boards = nullptr;
+	uint64_t const *hashes = nullptr;
+
+	uint64_t size() const { return offsets[info.max_moves + 1]; }
+	uint64_t count(uint32_t moves) const;
+
+	//sample picks a bucket uniformly among the non-empty buckets in [min_moves, max_moves]
+	// (or the nearest non-empty bucket if those are all empty), then a stage uniformly within it,
+	// using bits of 'random'. Returns false if the corpus is empty:
+	bool sample(uint32_t min_moves, uint32_t max_moves, uint64_t random, uint64_t *index, uint32_t *moves) const;
+
+private:
+	void unmap();
+	void const *mapping = nullptr;
+	size_t mapping_size = 0;
+	#ifdef _WIN32
+	void *file = nullptr;
+	void *file_mapping = nullptr;
+	#endif
+};
@@ -0,0 +1,90 @@
+#include "GLState.hpp"
+
+GLState gl_state;
+
+//a value no real object name or enum will have, so the first call is always issued:
+static const GLuint Unknown = -1U;
+
+void GLState::invalidate() {
+	program = Unknown;
+	vertex_array = Unknown;
+	array_buffer = Unknown;
+	uniform_buffer = Unknown;
+	active_texture = Unknown;
+	for (GLuint &t : texture_2d) {
+		t = Unknown;
+	}
+	depth_test = CapUnknown;
+	blend = CapUnknown;
+	cull_face = CapUnknown;
+	blend_sfactor = Unknown;
+	blend_dfactor = Unknown;
+	viewport_box[0] = viewport_box[1] = -1;
+	viewport_box[2] = viewport_box[3] = -1;
+}
+
+void GLState::use_program(GLuint program_) {
+	if (changed(program, program_)) glUseProgram(program_);
+}
+
+void GLState::bind_vertex_array(GLuint vao) {
+	if (changed(vertex_array, vao)) glBindVertexArray(vao);
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer) {
+	if (target == GL_ARRAY_BUFFER) {
+		if (changed(array_buffer, buffer)) glBindBuffer(target, buffer);
+	} else if (target == GL_UNIFORM_BUFFER) {
+		if (changed(uniform_buffer, buffer)) glBindBuffer(target, buffer);
+	} else {
+		++issued;
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GLState::bind_texture_2d(GLuint unit, GLuint texture) {
+	if (changed(active_texture, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+	if (unit < MaxTextureUnits) {
+		if (changed(texture_2d[unit], texture)) glBindTexture(GL_TEXTURE_2D, texture);
+	} else {
+		++issued;
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+}
+
+void GLState::enable(GLenum cap, bool on) {
+	Cap *cached = nullptr;
+	if (cap == GL_DEPTH_TEST) cached = &depth_test;
+	else if (cap == GL_BLEND) cached = &blend;
+	else if (cap == GL_CULL_FACE) cached = &cull_face;
+
+	if (!cached || changed(*cached, on ? CapOn : CapOff)) {
+		if (!cached) ++issued;
+		if (on) glEnable(cap);
+		else glDisable(cap);
+	}
+}
+
+void GLState::blend_func(GLenum sfactor, GLenum dfactor) {
+	if (blend_sfactor == sfactor && blend_dfactor == dfactor) {
+		++elided;
+		return;
+	}
+	blend_sfactor = sfactor;
+	blend_dfactor = dfactor;
+	++issued;
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	if (viewport_box[0] == x && viewport_box[1] == y && viewport_box[2] == width && viewport_box[3] == height) {
+		++elided;
+		return;
+	}
+	viewport_box[0] = x;
+	viewport_box[1] = y;
+	viewport_box[2] = width;
+	viewport_box[3] = height;
+	++issued;
+	glViewport(x, y, width, height);
+}
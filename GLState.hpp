@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstdint>
+
+// 'GLState' remembers the OpenGL state it last set and skips calls that
+// wouldn't change anything. It only knows about changes made through it, so
+// code that sets tracked state directly (or deletes a bound object) should
+// call invalidate() afterward.
+//
+// There is one OpenGL context, so there is one cache:
+//   gl_state.use_program(program);
+//   gl_state.enable(GL_DEPTH_TEST, true);
+
+struct GLState {
+	GLState() { invalidate(); }
+
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vao);
+	//GL_ARRAY_BUFFER or GL_UNIFORM_BUFFER (element array bindings are part of the vertex array, so aren't tracked):
+	void bind_buffer(GLenum target, GLuint buffer);
+	//binds 'texture' to GL_TEXTURE_2D on texture unit 'unit' (units past MaxTextureUnits aren't cached):
+	void bind_texture_2d(GLuint unit, GLuint texture);
+	//GL_DEPTH_TEST, GL_BLEND or GL_CULL_FACE (other capabilities are passed straight through):
+	void enable(GLenum cap, bool on);
+	void blend_func(GLenum sfactor, GLenum dfactor);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	//forget everything, so the next call of each kind is always issued:
+	void invalidate();
+
+	//calls made to OpenGL vs. skipped because they matched the cache:
+	uint64_t issued = 0;
+	uint64_t elided = 0;
+
+	static constexpr GLuint MaxTextureUnits = 8;
+
+private:
+	//returns true (and counts an issued call) if 'value' differs from 'cached', updating 'cached':
+	template< typename T >
+	bool changed(T &cached, T const &value) {
+		if (cached == value) {
+			++elided;
+			return false;
+		}
+		cached = value;
+		++issued;
+		return true;
+	}
+
+	GLuint program;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint uniform_buffer;
+	GLuint active_texture; //unit number, not GL_TEXTUREi
+	GLuint texture_2d[MaxTextureUnits];
+	//unknown, disabled or enabled:
+	enum Cap : uint8_t { CapUnknown, CapOff, CapOn };
+	Cap depth_test;
+	Cap blend;
+	Cap cull_face;
+	GLenum blend_sfactor;
+	GLenum blend_dfactor;
+	GLint viewport_box[4];
+};
+
+extern GLState gl_state;
@@ -0,0 +1,106 @@
+#include "GPUTimer.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+GPUTimer gpu_timer;
+
+constexpr uint32_t GPUTimer::Frames;
+constexpr uint32_t GPUTimer::Samples;
+
+char const *GPUTimer::pass_name(Pass pass) {
+	switch (pass) {
+		case Clear: return "clear";
+		case Tiles: return "tiles";
+		case Pieces: return "pieces";
+		default: return "?";
+	}
+}
+
+void GPUTimer::begin(Pass pass) {
+	if (!enabled) return;
+	end();
+
+	Query &query = queries[frame][pass];
+	if (query.name == 0) glGenQueries(1, &query.name);
+	if (query.pending) {
+		//this query is from Frames frames ago; only reuse it if the GPU is done with it:
+		collect(pass, query);
+		if (query.pending) {
+			++skipped;
+			return;
+		}
+	}
+	glBeginQuery(GL_TIME_ELAPSED, query.name);
+	active = &query;
+}
+
+void GPUTimer::end() {
+	if (!active) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	active->pending = true;
+	active = nullptr;
+}
+
+void GPUTimer::end_frame() {
+	if (!enabled) return;
+	end();
+	frame = (frame + 1) % Frames;
+	//read whatever has finished (oldest frames first, so history stays in order):
+	for (uint32_t age = 0; age < Frames; ++age) {
+		uint32_t f = (frame + age) % Frames;
+		for (uint32_t p = 0; p < PassCount; ++p) {
+			if (queries[f][p].pending) collect(Pass(p), queries[f][p]);
+		}
+	}
+}
+
+//records the result of 'query' if the GPU has it (otherwise leaves the query pending):
+void GPUTimer::collect(Pass pass, Query &query) {
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv(query.name, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return;
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v(query.name, GL_QUERY_RESULT, &ns);
+	query.pending = false;
+
+	history[pass][history_next[pass]] = ns;
+	history_next[pass] = (history_next[pass] + 1) % Samples;
+	history_count[pass] = std::min(history_count[pass] + 1, Samples);
+}
+
+GPUTimer::Stats GPUTimer::stats(Pass pass) const {
+	Stats ret;
+	ret.samples = history_count[pass];
+	if (ret.samples == 0) return ret;
+	uint64_t total = 0, max = 0;
+	for (uint32_t i = 0; i < ret.samples; ++i) {
+		total += history[pass][i];
+		max = std::max(max, history[pass][i]);
+	}
+	ret.average_ms = float(total) / float(ret.samples) * 1e-6f;
+	ret.max_ms = float(max) * 1e-6f;
+	return ret;
+}
+
+std::string GPUTimer::report() const {
+	std::ostringstream out;
+	out << "GPU ms (average / max):" << std::fixed << std::setprecision(3);
+	for (uint32_t p = 0; p < PassCount; ++p) {
+		Stats s = stats(Pass(p));
+		out << "  " << pass_name(Pass(p)) << " " << s.average_ms << " / " << s.max_ms;
+	}
+	if (skipped) out << "  (" << skipped << " passes skipped)";
+	return out.str();
+}
+
+void GPUTimer::release() {
+	end();
+	for (auto &frame_queries : queries) {
+		for (Query &query : frame_queries) {
+			if (query.name) glDeleteQueries(1, &query.name);
+			query = Query();
+		}
+	}
+}
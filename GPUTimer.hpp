@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstdint>
+#include <string>
+
+// 'GPUTimer' measures how long the GPU spends on each pass of a frame, with
+// GL_TIME_ELAPSED queries. Each pass has a query per frame in flight, and
+// results are only read once the GPU says they are available (usually a
+// frame or two later), so timing never makes the CPU wait.
+//
+// Passes can't nest (only one GL_TIME_ELAPSED query can be active), so
+// starting a pass ends the previous one:
+//   gpu_timer.begin(GPUTimer::Clear); ...draw...
+//   gpu_timer.begin(GPUTimer::Tiles); ...draw...
+//   gpu_timer.end();
+//   gpu_timer.end_frame();
+//
+// Until 'enabled' is set, all of these do nothing.
+
+struct GPUTimer {
+	enum Pass : uint32_t { Clear, Tiles, Pieces, PassCount };
+	static char const *pass_name(Pass pass);
+
+	bool enabled = false;
+
+	void begin(Pass pass);
+	void end();
+	void end_frame();
+
+	//rolling statistics over the last (up to) Samples measured frames:
+	struct Stats {
+		uint32_t samples = 0;
+		float average_ms = 0.0f;
+		float max_ms = 0.0f;
+	};
+	Stats stats(Pass pass) const;
+	//one line of statistics for every pass:
+	std::string report() const;
+
+	//passes not timed because their query from Frames frames ago was still waiting for the GPU:
+	uint64_t skipped = 0;
+
+	//delete the query objects (before the context goes away):
+	void release();
+
+	static constexpr uint32_t Frames = 3; //frames in flight
+	static constexpr uint32_t Samples = 120;
+
+private:
+	struct Query {
+		GLuint name = 0;
+		bool pending = false; //ended, result not read yet
+	};
+	Query queries[Frames][PassCount];
+	uint32_t frame = 0; //index into 'queries'
+	Query *active = nullptr;
+
+	//last Samples results of each pass, in nanoseconds, as rings:
+	uint64_t history[PassCount][Samples] = {};
+	uint32_t history_count[PassCount] = {};
+	uint32_t history_next[PassCount] = {};
+
+	void collect(Pass pass, Query &query);
+};
+
+extern GPUTimer gpu_timer;
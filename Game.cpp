@@ -3,6 +3,10 @@
 #include "gl_errors.hpp" //helper for dumpping OpenGL error messages
 #include "read_chunk.hpp" //helper for reading a vector of structures from a file
 #include "data_path.hpp" //helper to get paths relative to executable
+#include "GLState.hpp" //skips redundant state changes
+#include "CompactVertex.hpp" //16-byte vertex format written by bake-meshes --compact
+#include "ProgramCache.hpp" //keeps linked shader programs between runs
+#include "GPUTimer.hpp" //times render passes on the GPU
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -10,161 +14,377 @@
 #include <fstream>
 #include <map>
 #include <cstddef>
-//#include <random>
-
-//helper defined later; throws if shader compilation fails:
-static GLuint compile_shader(GLenum type, std::string const &source);
-
-Game::Game() {
-	{ //create an opengl program to perform sun/sky (well, directional+hemispherical) lighting:
-		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
-			"#version 330\n"
-			"uniform mat4 object_to_clip;\n"
-			"uniform mat4x3 object_to_light;\n"
-			"uniform mat3 normal_to_light;\n"
+#include <chrono>
+#include <future>
+#include <cmath>
+
+//call f(begin, end) for every run [begin,end) of consecutive nonzero flags:
+template< typename F >
+static void for_each_run(std::vector< uint8_t > const &flags, F const &f) {
+	for (uint32_t begin = 0; begin < flags.size(); ) {
+		if (!flags[begin]) {
+			++begin;
+			continue;
+		}
+		uint32_t end = begin + 1;
+		while (end < flags.size() && flags[end]) ++end;
+		f(begin, end);
+		begin = end;
+	}
+}
+
+//true unless the box [min,max] is entirely outside one of the planes of the view volume:
+static bool box_in_view(glm::mat4 const &world_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec4 corners[8];
+	for (uint32_t i = 0; i < 8; ++i) {
+		corners[i] = world_to_clip * glm::vec4(
+			(i & 1 ? max.x : min.x),
+			(i & 2 ? max.y : min.y),
+			(i & 4 ? max.z : min.z),
+			1.0f);
+	}
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		bool all_below = true, all_above = true;
+		for (glm::vec4 const &c : corners) {
+			all_below = all_below && (c[axis] < -c.w);
+			all_above = all_above && (c[axis] > c.w);
+		}
+		if (all_below || all_above) return false;
+	}
+	return true;
+}
+
+//helpers defined later for building programs: start_program compiles and links without waiting for the results
+// (so the driver can work on several programs at once), finish_program waits and throws if compiling or linking failed.
+//With a cache, programs are loaded from it when possible, and stored to it otherwise:
+struct PendingProgram {
+	GLuint program = 0;
+	GLuint vertex_shader = 0; //(zero if the program came from the cache)
+	GLuint fragment_shader = 0;
+	std::string vertex_source;
+	std::string fragment_source;
+};
+static PendingProgram start_program(std::string const &vertex_source, std::string const &fragment_source, ProgramCache *cache = nullptr);
+static GLuint finish_program(PendingProgram const &pending, ProgramCache *cache = nullptr);
+//lets drivers with GL_KHR_parallel_shader_compile compile on their own threads:
+static void allow_parallel_shader_compile();
+
+//uniform block shared by every program; must match Game::Scene:
+static const char *scene_block_source =
+	"layout(std140) uniform Scene {\n"
+	"	mat4 world_to_clip;\n"
+	"	vec3 sun_direction;\n"
+	"	vec3 sun_color;\n"
+	"	vec3 sky_direction;\n"
+	"	vec3 sky_color;\n"
+	"};\n";
+
+//fragment shader shared by the lit programs; does sun/sky (well, directional+hemispherical) lighting:
+static const std::string lit_fragment_shader_source = std::string(
+	"#version 330\n")
+	+ scene_block_source +
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec4 color;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	vec3 total_light = vec3(0.0, 0.0, 0.0);\n"
+	"	vec3 n = normalize(normal);\n"
+	"	{ //sky (hemisphere) light:\n"
+	"		vec3 l = sky_direction;\n"
+	"		float nl = 0.5 + 0.5 * dot(n,l);\n"
+	"		total_light += nl * sky_color;\n"
+	"	}\n"
+	"	{ //sun (directional) light:\n"
+	"		vec3 l = sun_direction;\n"
+	"		float nl = max(0.0, dot(n,l));\n"
+	"		total_light += nl * sun_color;\n"
+	"	}\n"
+	"	fragColor = vec4(color.rgb * total_light, color.a);\n"
+	"}\n";
+
+//...and the same lighting on the CPU, for baking into vertex colors
+// (exact for these scenes, since meshes are flat-shaded and only ever translated):
+static glm::vec3 total_light(Game::Scene const &scene, glm::vec3 const &normal) {
+	glm::vec3 n = glm::normalize(normal);
+	glm::vec3 total = glm::vec3(0.0f);
+	total += (0.5f + 0.5f * glm::dot(n, glm::vec3(scene.sky_direction))) * glm::vec3(scene.sky_color);
+	total += std::max(0.0f, glm::dot(n, glm::vec3(scene.sun_direction))) * glm::vec3(scene.sun_color);
+	return total;
+}
+
+//fragment shader for Settings::baked_lighting, where color already includes the lighting:
+static const std::string baked_fragment_shader_source =
+	"#version 330\n"
+	"in vec4 color;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = color;\n"
+	"}\n";
+
+//contents of meshes.blob, as read by load_mesh_blob:
+struct MeshBlob {
+	bool compact_vertices = false; //the blob stores CompactVertex records ("dat1")
+	std::vector< Game::Vertex > vertices; //(unpacked, even if the blob stores compact vertices)
+	std::vector< CompactVertex > compact; //as stored, if compact_vertices
+	std::vector< uint32_t > indices; //empty unless the meshes were baked by bake-meshes
+	std::map< std::string, Game::Mesh > index;
+};
+
+//reads and checks meshes.blob; runs on a worker thread (see Game::Game), so it doesn't touch OpenGL:
+static MeshBlob load_mesh_blob(std::string const &filename) {
+	MeshBlob loaded;
+	std::ifstream blob(filename, std::ios::binary);
+	//The blob will be made up of three chunks:
+	// the first chunk will be vertex data (interleaved position/normal/color; "dat0" as floats, "dat1" as CompactVertex)
+	// the second chunk will be characters
+	// the third chunk will be an index, mapping a name (range of characters) to a mesh (range of vertex data)
+	//...optionally followed by two more, written by bake-meshes:
+	// the fourth chunk will be vertex indices, relative to the first vertex of their mesh
+	// the fifth chunk will be, for each index entry, its range of vertex indices
+
+	//read vertex data:
+	std::vector< Game::Vertex > &vertices = loaded.vertices;
+	std::vector< CompactVertex > &compact = loaded.compact;
+	if (peek_chunk(blob, "dat1")) {
+		loaded.compact_vertices = true;
+		read_chunk(blob, "dat1", &compact);
+		vertices.reserve(compact.size());
+		for (CompactVertex const &c : compact) {
+			Game::Vertex v;
+			v.Position = c.position();
+			v.Normal = c.normal();
+			v.Color = c.Color;
+			vertices.emplace_back(v);
+		}
+	} else {
+		read_chunk(blob, "dat0", &vertices);
+	}
+
+	//read character data (for names):
+	std::vector< char > names;
+	read_chunk(blob, "str0", &names);
+
+	//read index:
+	struct IndexEntry {
+		uint32_t name_begin;
+		uint32_t name_end;
+		uint32_t vertex_begin;
+		uint32_t vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "IndexEntry should be packed.");
+
+	std::vector< IndexEntry > index_entries;
+	read_chunk(blob, "idx0", &index_entries);
+
+	//read vertex indices, if the meshes have been baked:
+	std::vector< uint32_t > &indices = loaded.indices;
+	struct IndexRange {
+		uint32_t index_begin;
+		uint32_t index_end;
+	};
+	static_assert(sizeof(IndexRange) == 8, "IndexRange should be packed.");
+	std::vector< IndexRange > index_ranges;
+	if (peek_chunk(blob, "ind0")) {
+		read_chunk(blob, "ind0", &indices);
+		read_chunk(blob, "inr0", &index_ranges);
+		if (index_ranges.size() != index_entries.size()) {
+			throw std::runtime_error("index ranges don't match index.");
+		}
+	}
+
+	if (blob.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in meshes file." << std::endl;
+	}
+
+	//create map to store index entries:
+	std::map< std::string, Game::Mesh > &index = loaded.index;
+	for (uint32_t i = 0; i < index_entries.size(); ++i) {
+		IndexEntry const &e = index_entries[i];
+		if (e.name_begin > e.name_end || e.name_end > names.size()) {
+			throw std::runtime_error("invalid name indices in index.");
+		}
+		if (e.vertex_begin > e.vertex_end || e.vertex_end > vertices.size()) {
+			throw std::runtime_error("invalid vertex indices in index.");
+		}
+		Game::Mesh mesh;
+		mesh.first = e.vertex_begin;
+		mesh.count = e.vertex_end - e.vertex_begin;
+		if (!index_ranges.empty()) {
+			IndexRange const &r = index_ranges[i];
+			if (r.index_begin > r.index_end || r.index_end > indices.size()) {
+				throw std::runtime_error("invalid index range.");
+			}
+			for (uint32_t j = r.index_begin; j < r.index_end; ++j) {
+				if (indices[j] >= uint32_t(mesh.count)) throw std::runtime_error("vertex index out of range.");
+			}
+			mesh.index_first = r.index_begin;
+			mesh.index_count = r.index_end - r.index_begin;
+		}
+		auto ret = index.insert(std::make_pair(
+			std::string(names.begin() + e.name_begin, names.begin() + e.name_end),
+			mesh));
+		if (!ret.second) {
+			throw std::runtime_error("duplicate name in index.");
+		}
+	}
+
+	return loaded;
+}
+
+Game::Game(Settings const &settings) : board_size(settings.board_size), render_mode(settings.render_mode), rng(settings.seed), remember_stages(settings.remember_stages), wait_for_stages(settings.wait_for_stages) {
+	if (board_size.x == 0 || board_size.y == 0) {
+		throw std::runtime_error("board must have at least one row and column.");
+	}
+	if (render_mode == RenderTexture) { //the board texture must fit:
+		GLint max_texture_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+		if (board_size.x > uint32_t(max_texture_size) || board_size.y > uint32_t(max_texture_size)) {
+			std::cerr << "NOTE: " << board_size.x << "x" << board_size.y << " board is larger than the maximum texture size (" << max_texture_size << "); drawing it with instancing instead." << std::endl;
+			render_mode = RenderInstanced;
+		}
+	}
+	//read and check the mesh blob on a worker thread while this one gets the shader programs going
+	//(the results are picked up just before they are uploaded, below):
+	std::future< MeshBlob > mesh_blob = std::async(std::launch::async, load_mesh_blob, data_path("meshes.blob"));
+
+	std::string const &fragment_shader_source = (settings.baked_lighting ? baked_fragment_shader_source : lit_fragment_shader_source);
+
+	//linked programs are kept (as driver-specific binaries) between runs, since compiling is a noticeable part of startup on slow machines:
+	ProgramCache program_cache(user_path("shaders.cache"));
+
+	//programs are started here and finished (i.e., their compile and link status checked) only once they are needed,
+	//so drivers with GL_KHR_parallel_shader_compile can build them at the same time on their own threads:
+	allow_parallel_shader_compile();
+	PendingProgram simple_shading_pending, board_texture_shading_pending;
+
+	{ //start an opengl program to perform sun/sky (well, directional+hemispherical) lighting:
+		std::string vertex_shader_source = std::string(
+			"#version 330\n")
+			+ scene_block_source +
 			"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 			"in vec3 Normal;\n"
 			"in vec4 Color;\n"
+			"in vec3 Offset;\n" //per-instance: objects are only ever translated, so this is all of object_to_world
 			"out vec3 position;\n"
 			"out vec3 normal;\n"
 			"out vec4 color;\n"
 			"void main() {\n"
-			"	gl_Position = object_to_clip * Position;\n"
-			"	position = object_to_light * Position;\n"
-			"	normal = normal_to_light * Normal;\n"
+			"	vec4 world_position = vec4(Position.xyz + Offset, 1.0);\n"
+			"	gl_Position = world_to_clip * world_position;\n"
+			"	position = world_position.xyz;\n"
+			"	normal = Normal;\n"
 			"	color = Color;\n"
-			"}\n"
-		);
-
-		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
-			"#version 330\n"
-			"uniform vec3 sun_direction;\n"
-			"uniform vec3 sun_color;\n"
-			"uniform vec3 sky_direction;\n"
-			"uniform vec3 sky_color;\n"
-			"in vec3 position;\n"
-			"in vec3 normal;\n"
-			"in vec4 color;\n"
-			"out vec4 fragColor;\n"
+			"}\n";
+
+		simple_shading_pending = start_program(vertex_shader_source, fragment_shader_source, &program_cache);
+	}
+
+	{ //start a program that draws one instance per board cell, placing it from gl_InstanceID and culling it by the board texture:
+		std::string vertex_shader_source = std::string(
+			"#version 330\n")
+			+ scene_block_source +
+			"uniform usampler2D board;\n"
+			"uniform uint piece;\n" //0 (Board::Empty) draws every cell; otherwise only cells holding this piece
+			"uniform float z;\n"
+			"uniform ivec2 first_cell;\n" //instances cover the cells in view, 'columns' cells per row, starting at first_cell (x, world y)
+			"uniform int columns;\n"
+			"layout(location=0) in vec4 Position;\n"
+			"in vec3 Normal;\n"
+			"in vec4 Color;\n"
+			"out vec3 position;\n"
+			"out vec3 normal;\n"
+			"out vec4 color;\n"
 			"void main() {\n"
-			"	vec3 total_light = vec3(0.0, 0.0, 0.0);\n"
-			"	vec3 n = normalize(normal);\n"
-			"	{ //sky (hemisphere) light:\n"
-			"		vec3 l = sky_direction;\n"
-			"		float nl = 0.5 + 0.5 * dot(n,l);\n"
-			"		total_light += nl * sky_color;\n"
-			"	}\n"
-			"	{ //sun (directional) light:\n"
-			"		vec3 l = sun_direction;\n"
-			"		float nl = max(0.0, dot(n,l));\n"
-			"		total_light += nl * sun_color;\n"
+			"	ivec2 size = textureSize(board, 0);\n"
+			"	ivec2 world_cell = first_cell + ivec2(gl_InstanceID % columns, gl_InstanceID / columns);\n"
+			"	ivec2 cell = ivec2(world_cell.x, size.y - 1 - world_cell.y);\n" //(column, row); row 0 is the top row
+			"	normal = Normal;\n"
+			"	color = Color;\n"
+			"	if (piece != 0u && texelFetch(board, cell, 0).r != piece) {\n"
+			"		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n" //every vertex outside the clip volume, so the clipper drops the instance
+			"		position = vec3(0.0);\n"
+			"		return;\n"
 			"	}\n"
-			"	fragColor = vec4(color.rgb * total_light, color.a);\n"
-			"}\n"
-		);
-
-		simple_shading.program = glCreateProgram();
-		glAttachShader(simple_shading.program, vertex_shader);
-		glAttachShader(simple_shading.program, fragment_shader);
-		//shaders are reference counted so this makes sure they are freed after program is deleted:
-		glDeleteShader(vertex_shader);
-		glDeleteShader(fragment_shader);
-
-		//link the shader program and throw errors if linking fails:
-		glLinkProgram(simple_shading.program);
-		GLint link_status = GL_FALSE;
-		glGetProgramiv(simple_shading.program, GL_LINK_STATUS, &link_status);
-		if (link_status != GL_TRUE) {
-			std::cerr << "Failed to link shader program." << std::endl;
-			GLint info_log_length = 0;
-			glGetProgramiv(simple_shading.program, GL_INFO_LOG_LENGTH, &info_log_length);
-			std::vector< GLchar > info_log(info_log_length, 0);
-			GLsizei length = 0;
-			glGetProgramInfoLog(simple_shading.program, GLsizei(info_log.size()), &length, &info_log[0]);
-			std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-			throw std::runtime_error("failed to link program");
-		}
+			"	vec3 offset = vec3(vec2(world_cell) + 0.5, z);\n"
+			"	vec4 world_position = vec4(Position.xyz + offset, 1.0);\n"
+			"	gl_Position = world_to_clip * world_position;\n"
+			"	position = world_position.xyz;\n"
+			"}\n";
+
+		board_texture_shading_pending = start_program(vertex_shader_source, fragment_shader_source, &program_cache);
 	}
 
-	{ //read back uniform and attribute locations from the shader program:
-		simple_shading.object_to_clip_mat4 = glGetUniformLocation(simple_shading.program, "object_to_clip");
-		simple_shading.object_to_light_mat4x3 = glGetUniformLocation(simple_shading.program, "object_to_light");
-		simple_shading.normal_to_light_mat3 = glGetUniformLocation(simple_shading.program, "normal_to_light");
+	{ //create the uniform buffer behind every program's Scene block:
+		//lighting never changes, so it is only written here; set_view() writes world_to_clip:
+		scene.sun_direction = glm::vec4(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f)), 0.0f);
+		scene.sun_color = glm::vec4(0.81f, 0.81f, 0.76f, 0.0f);
+		scene.sky_direction = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		scene.sky_color = glm::vec4(0.2f, 0.2f, 0.3f, 0.0f);
 
-		simple_shading.sun_direction_vec3 = glGetUniformLocation(simple_shading.program, "sun_direction");
-		simple_shading.sun_color_vec3 = glGetUniformLocation(simple_shading.program, "sun_color");
-		simple_shading.sky_direction_vec3 = glGetUniformLocation(simple_shading.program, "sky_direction");
-		simple_shading.sky_color_vec3 = glGetUniformLocation(simple_shading.program, "sky_color");
+		glGenBuffers(1, &scene_ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, scene_ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Scene), &scene, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, SceneBinding, scene_ubo);
+	}
 
+	//wait for the programs:
+	simple_shading.program = finish_program(simple_shading_pending, &program_cache);
+	board_texture_shading.program = finish_program(board_texture_shading_pending, &program_cache);
+	program_cache.save();
+
+	{ //read back uniform and attribute locations from the shader programs:
 		simple_shading.Position_vec4 = glGetAttribLocation(simple_shading.program, "Position");
 		simple_shading.Normal_vec3 = glGetAttribLocation(simple_shading.program, "Normal");
 		simple_shading.Color_vec4 = glGetAttribLocation(simple_shading.program, "Color");
-	}
+		simple_shading.Offset_vec3 = glGetAttribLocation(simple_shading.program, "Offset");
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-	};
-	static_assert(sizeof(Vertex) == 28, "Vertex should be packed.");
-
-	{ //load mesh data from a binary blob:
-		std::ifstream blob(data_path("meshes.blob"), std::ios::binary);
-		//The blob will be made up of three chunks:
-		// the first chunk will be vertex data (interleaved position/normal/color)
-		// the second chunk will be characters
-		// the third chunk will be an index, mapping a name (range of characters) to a mesh (range of vertex data)
+		board_texture_shading.board_usampler2D = glGetUniformLocation(board_texture_shading.program, "board");
+		board_texture_shading.piece_uint = glGetUniformLocation(board_texture_shading.program, "piece");
+		board_texture_shading.z_float = glGetUniformLocation(board_texture_shading.program, "z");
+		board_texture_shading.first_cell_ivec2 = glGetUniformLocation(board_texture_shading.program, "first_cell");
+		board_texture_shading.columns_int = glGetUniformLocation(board_texture_shading.program, "columns");
 
-		//read vertex data:
-		std::vector< Vertex > vertices;
-		read_chunk(blob, "dat0", &vertices);
+		board_texture_shading.Position_vec4 = glGetAttribLocation(board_texture_shading.program, "Position");
+		board_texture_shading.Normal_vec3 = glGetAttribLocation(board_texture_shading.program, "Normal");
+		board_texture_shading.Color_vec4 = glGetAttribLocation(board_texture_shading.program, "Color");
 
-		//read character data (for names):
-		std::vector< char > names;
-		read_chunk(blob, "str0", &names);
+		//the board is always read from texture unit 0:
+		glUseProgram(board_texture_shading.program);
+		glUniform1i(board_texture_shading.board_usampler2D, 0);
+		glUseProgram(0);
+	}
 
-		//read index:
-		struct IndexEntry {
-			uint32_t name_begin;
-			uint32_t name_end;
-			uint32_t vertex_begin;
-			uint32_t vertex_end;
+	{ //connect every program's Scene block to the uniform buffer:
+		auto bind_scene_block = [](GLuint program) {
+			GLuint index = glGetUniformBlockIndex(program, "Scene");
+			if (index == GL_INVALID_INDEX) throw std::runtime_error("program has no Scene block.");
+			glUniformBlockBinding(program, index, SceneBinding);
 		};
-		static_assert(sizeof(IndexEntry) == 16, "IndexEntry should be packed.");
-
-		std::vector< IndexEntry > index_entries;
-		read_chunk(blob, "idx0", &index_entries);
+		bind_scene_block(simple_shading.program);
+		bind_scene_block(board_texture_shading.program);
+	}
 
-		if (blob.peek() != EOF) {
-			std::cerr << "WARNING: trailing data in meshes file." << std::endl;
-		}
+	bool compact_vertices = false; //meshes_vbo holds CompactVertex rather than Vertex records
+	{ //set up mesh data from the blob (waiting for the worker thread to finish reading it, if it hasn't yet):
+		MeshBlob loaded = mesh_blob.get(); //(rethrows anything load_mesh_blob threw)
+		compact_vertices = loaded.compact_vertices;
+		std::vector< Vertex > &vertices = loaded.vertices;
+		std::vector< CompactVertex > &compact = loaded.compact; //(uploaded as-is; 'vertices' is an unpacked copy for the code below)
+		std::vector< uint32_t > const &indices = loaded.indices;
+		std::map< std::string, Mesh > const &index = loaded.index;
 
-		//upload vertex data to the graphics card:
-		glGenBuffers(1, &meshes_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, meshes_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		//create map to store index entries:
-		std::map< std::string, Mesh > index;
-		for (IndexEntry const &e : index_entries) {
-			if (e.name_begin > e.name_end || e.name_end > names.size()) {
-				throw std::runtime_error("invalid name indices in index.");
-			}
-			if (e.vertex_begin > e.vertex_end || e.vertex_end > vertices.size()) {
-				throw std::runtime_error("invalid vertex indices in index.");
-			}
-			Mesh mesh;
-			mesh.first = e.vertex_begin;
-			mesh.count = e.vertex_end - e.vertex_begin;
-			auto ret = index.insert(std::make_pair(
-				std::string(names.begin() + e.name_begin, names.begin() + e.name_end),
-				mesh));
-			if (!ret.second) {
-				throw std::runtime_error("duplicate name in index.");
+		if (settings.baked_lighting) { //light every vertex once, here, instead of every fragment in every frame:
+			for (size_t i = 0; i < vertices.size(); ++i) {
+				glm::vec3 lit = glm::vec3(vertices[i].Color) * total_light(scene, vertices[i].Normal);
+				glm::u8vec4 color = glm::u8vec4(glm::min(lit + glm::vec3(0.5f), glm::vec3(255.0f)), vertices[i].Color.w);
+				vertices[i].Color = color;
+				if (compact_vertices) compact[i].Color = color;
 			}
 		}
 
+
 		//look up into index map to extract meshes:
 		auto lookup = [&index](std::string const &name) -> Mesh {
 			auto f = index.find(name);
@@ -176,52 +396,242 @@ Game::Game() {
 		tile_mesh = lookup("Tile");
         blackpiece_mesh = lookup("blackpiece");  // I Change the loading target
         whitepiece_mesh = lookup("whitepiece");
+
+		//pieces may come with coarser versions, named like "blackpiece.lod1" (see meshes/export-meshes.py):
+		auto lookup_lods = [&](std::string const &name, Mesh const &mesh, std::vector< Mesh > *lods) {
+			lods->assign(1, mesh);
+			for (uint32_t level = 1; level < MaxPieceLods; ++level) {
+				auto f = index.find(name + ".lod" + std::to_string(level));
+				if (f == index.end()) break;
+				lods->emplace_back(f->second);
+			}
+			//...and always end with an impostor, generated here: a flat quad covering the piece,
+			// on top of it, in the piece's average color:
+			glm::vec3 min = vertices[mesh.first].Position, max = min;
+			glm::vec4 color = glm::vec4(0.0f);
+			for (GLint i = mesh.first; i < mesh.first + mesh.count; ++i) {
+				min = glm::min(min, vertices[i].Position);
+				max = glm::max(max, vertices[i].Position);
+				color += glm::vec4(vertices[i].Color);
+			}
+			Vertex corner;
+			corner.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			corner.Color = glm::u8vec4(color / float(mesh.count) + glm::vec4(0.5f));
+			Mesh impostor;
+			impostor.first = GLint(vertices.size());
+			impostor.count = 6;
+			for (glm::vec2 xy : { glm::vec2(min.x, min.y), glm::vec2(max.x, min.y), glm::vec2(max.x, max.y), glm::vec2(min.x, min.y), glm::vec2(max.x, max.y), glm::vec2(min.x, max.y) }) {
+				corner.Position = glm::vec3(xy, max.z);
+				vertices.emplace_back(corner);
+			}
+			lods->emplace_back(impostor);
+		};
+		lookup_lods("blackpiece", blackpiece_mesh, &blackpiece_lods);
+		lookup_lods("whitepiece", whitepiece_mesh, &whitepiece_lods);
+		if (blackpiece_lods.size() != whitepiece_lods.size()) {
+			throw std::runtime_error("blackpiece and whitepiece should have the same number of levels of detail.");
+		}
+
+		//upload vertex data to the graphics card:
+		glGenBuffers(1, &meshes_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, meshes_vbo);
+		if (compact_vertices) {
+			//(the impostors were appended to 'vertices' above, so pack them too)
+			for (size_t i = compact.size(); i < vertices.size(); ++i) {
+				compact.emplace_back(vertices[i].Position, vertices[i].Normal, vertices[i].Color);
+			}
+			glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex) * compact.size(), compact.data(), GL_STATIC_DRAW);
+		} else {
+			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (!indices.empty()) { //...and indices, if there are any:
+			glGenBuffers(1, &meshes_ibo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes_ibo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+
+		//tile chunks are baked from a copy of the tile mesh (as triangles):
+		tile_vertices.clear();
+		if (tile_mesh.index_count) {
+			for (GLsizei i = 0; i < tile_mesh.index_count; ++i) {
+				tile_vertices.emplace_back(vertices[tile_mesh.first + indices[tile_mesh.index_first + i]]);
+			}
+		} else {
+			tile_vertices.assign(vertices.begin() + tile_mesh.first, vertices.begin() + tile_mesh.first + tile_mesh.count);
+		}
+		tile_min = tile_max = tile_vertices.empty() ? glm::vec3(0.0f) : tile_vertices[0].Position;
+		for (Vertex const &v : tile_vertices) {
+			tile_min = glm::min(tile_min, v.Position);
+			tile_max = glm::max(tile_max, v.Position);
+		}
 	}
 
+	//point a program's Position/Normal/Color attributes at meshes_vbo (bound to GL_ARRAY_BUFFER), in whichever format it holds:
+	auto point_at_meshes_vbo = [&](GLuint Position_vec4, GLuint Normal_vec3, GLuint Color_vec4) {
+		//note that I'm specifying a 3-vector for a 4-vector attribute here, and this is okay to do:
+		if (compact_vertices) {
+			glVertexAttribPointer(Position_vec4, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (GLbyte *)0 + offsetof(CompactVertex, Position));
+		} else {
+			glVertexAttribPointer(Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Position));
+		}
+		glEnableVertexAttribArray(Position_vec4);
+		if (Normal_vec3 != -1U) {
+			if (compact_vertices) {
+				//(packed formats always have size 4; the shader ignores the fourth component)
+				glVertexAttribPointer(Normal_vec3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), (GLbyte *)0 + offsetof(CompactVertex, Normal));
+			} else {
+				glVertexAttribPointer(Normal_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Normal));
+			}
+			glEnableVertexAttribArray(Normal_vec3);
+		}
+		if (Color_vec4 != -1U) {
+			if (compact_vertices) {
+				glVertexAttribPointer(Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), (GLbyte *)0 + offsetof(CompactVertex, Color));
+			} else {
+				glVertexAttribPointer(Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Color));
+			}
+			glEnableVertexAttribArray(Color_vec4);
+		}
+	};
+
 	{ //create vertex array object to hold the map from the mesh vertex buffer to shader program attributes:
 		glGenVertexArrays(1, &meshes_for_simple_shading_vao);
 		glBindVertexArray(meshes_for_simple_shading_vao);
 		glBindBuffer(GL_ARRAY_BUFFER, meshes_vbo);
-		//note that I'm specifying a 3-vector for a 4-vector attribute here, and this is okay to do:
-		glVertexAttribPointer(simple_shading.Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Position));
-		glEnableVertexAttribArray(simple_shading.Position_vec4);
-		if (simple_shading.Normal_vec3 != -1U) {
-			glVertexAttribPointer(simple_shading.Normal_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Normal));
-			glEnableVertexAttribArray(simple_shading.Normal_vec3);
-		}
-		if (simple_shading.Color_vec4 != -1U) {
-			glVertexAttribPointer(simple_shading.Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Color));
-			glEnableVertexAttribArray(simple_shading.Color_vec4);
-		}
+		point_at_meshes_vbo(simple_shading.Position_vec4, simple_shading.Normal_vec3, simple_shading.Color_vec4);
+
+		//per-instance offsets come from instance_stream, advancing once per instance rather than per vertex;
+		//draw() points the attribute at each layer's offsets before drawing it:
+		instance_stream.reset(new StreamBuffer(1 << 20));
+		glBindBuffer(GL_ARRAY_BUFFER, instance_stream->buffer);
+		glVertexAttribPointer(simple_shading.Offset_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLbyte *)0);
+		glVertexAttribDivisor(simple_shading.Offset_vec3, 1);
+		glEnableVertexAttribArray(simple_shading.Offset_vec3);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		//(the element array binding is part of the vertex array object's state)
+		if (meshes_ibo != -1U) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes_ibo);
+		glBindVertexArray(0);
+	}
+
+	{ //...and another to connect the mesh vertex buffer to the board texture program:
+		glGenVertexArrays(1, &meshes_for_board_texture_shading_vao);
+		glBindVertexArray(meshes_for_board_texture_shading_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, meshes_vbo);
+		point_at_meshes_vbo(board_texture_shading.Position_vec4, board_texture_shading.Normal_vec3, board_texture_shading.Color_vec4);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (meshes_ibo != -1U) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes_ibo);
+		glBindVertexArray(0);
+	}
+
+	if (render_mode == RenderTexture) { //allocate the board texture; draw() fills it whenever the board changes
+		glGenTextures(1, &board_tex);
+		glBindTexture(GL_TEXTURE_2D, board_tex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, board_size.x, board_size.y, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+		//integer textures can't be filtered (and the shader only uses texelFetch anyway):
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 
+	//the setup above changed bindings directly:
+	gl_state.invalidate();
+
 	GL_ERRORS();
 
 	//----------------
-	//set up game board with meshes and rolls:
-    uint32_t numel = board_size.x * board_size.y;
-	board_rotations.reserve(numel);
-    whitepieces.reserve(numel);
-    blackpieces.reserve(numel);
+	//start with the whole board in view:
+	camera.center = 0.5f * glm::vec2(board_size);
 
-	for (uint32_t i = 0; i < board_size.x * board_size.y; ++i) {
-		board_rotations.emplace_back(glm::quat());
-	}
+	//set up game board:
+    if (render_mode == RenderInstanced) {
+        uint32_t numel = board_size.x * board_size.y;
+        whitepieces.reserve(numel);
+        blackpieces.reserve(numel);
+    }
+
+    //boards small enough to pack can be rated by optimal solution length:
+    if (board.can_pack() && board_size.x <= Solver::MaxLine && board_size.y <= Solver::MaxLine) {
+        try {  //prefer stages rated ahead of time by build-corpus
+            stage_corpus.reset(new Corpus(data_path("stages.corpus")));
+            if (stage_corpus->info.width != board_size.x || stage_corpus->info.height != board_size.y || stage_corpus->size() == 0) {
+                std::cerr << "NOTE: stage corpus doesn't have any " << board_size.x << "x" << board_size.y << " stages." << std::endl;
+                stage_corpus.reset();
+            }
+        } catch (std::exception const &e) {
+            std::cerr << "NOTE: not using stage corpus (" << e.what() << ")." << std::endl;
+        }
+        if (stage_corpus) {
+            stage_solver.reset(new Solver(board_size));
+        } else {
+            stage_worker.reset(new StageWorker(board_size, stage_moves.x, stage_moves.y, rng()));
+        }
+
+        if (remember_stages) {
+            try {  //remember stages served in earlier sessions
+                seen_stages.load(user_path("seen-stages.bloom"));
+            } catch (std::exception const &e) {
+                std::cerr << "NOTE: not loading seen stages (" << e.what() << ")." << std::endl;
+            }
+        }
+    }
 
     generate_new_stage();
 }
 
 Game::~Game() {
+    if (remember_stages && seen_stages.inserted > 0) {
+        try {
+            seen_stages.save(user_path("seen-stages.bloom"));
+        } catch (std::exception const &e) {
+            std::cerr << "WARNING: failed to save seen stages (" << e.what() << ")." << std::endl;
+        }
+    }
+
 	glDeleteVertexArrays(1, &meshes_for_simple_shading_vao);
 	meshes_for_simple_shading_vao = -1U;
 
+	glDeleteVertexArrays(1, &meshes_for_board_texture_shading_vao);
+	meshes_for_board_texture_shading_vao = -1U;
+
+	for (auto &c : tile_chunks) {
+		glDeleteVertexArrays(1, &c.second.vao);
+		glDeleteBuffers(1, &c.second.vbo);
+	}
+	tile_chunks.clear();
+
+	if (board_tex != -1U) {
+		glDeleteTextures(1, &board_tex);
+		board_tex = -1U;
+	}
+
 	glDeleteBuffers(1, &meshes_vbo);
 	meshes_vbo = -1U;
 
+	if (meshes_ibo != -1U) {
+		glDeleteBuffers(1, &meshes_ibo);
+		meshes_ibo = -1U;
+	}
+
+	instance_stream.reset();
+
+	glDeleteBuffers(1, &scene_ubo);
+	scene_ubo = -1U;
+
 	glDeleteProgram(simple_shading.program);
 	simple_shading.program = -1U;
 
+	glDeleteProgram(board_texture_shading.program);
+	board_texture_shading.program = -1U;
+
+	//deleting bound objects unbinds them:
+	gl_state.invalidate();
+
 	GL_ERRORS();
 }
 
@@ -239,278 +649,555 @@ bool Game::handle_event(SDL_Event const &evt, glm::uvec2 window_size) {
             return true;
         }
 
-        {  //powerful slide (remove duplicate objects in the same row/column)
-            if (evt.key.keysym.mod == KMOD_LSHIFT || evt.key.keysym.mod == KMOD_RSHIFT) {
-                auto checkPiece = [] (Piece& prevPiece, uint32_t row, uint32_t column) {
-                    if (board_state[row][column] == prevPiece) {
-                        board_state[row][column] = Empty;
-                    } else if (board_state[row][column] != Empty) {
-                        prevPiece = board_state[row][column];
-                    }
-                };
-                if (evt.key.keysym.scancode == SDL_SCANCODE_LEFT ||
-                    evt.key.keysym.scancode == SDL_SCANCODE_RIGHT) {  //horizontal powerful slide
-                    for (uint32_t row = 0; row < board_size.y; ++row) {
-                        uint32_t column = 0;
-                        Piece prevPiece = Empty;
-                        while (prevPiece == Empty && column < board_size.x) {  //find first non-Empty piece
-                            prevPiece = board_state[row][column++];
-                        }
-                        for (; column < board_size.x; ++column) {
-                            checkPiece(prevPiece, row, column);
-                        }
-                    }
-                } else if (evt.key.keysym.scancode == SDL_SCANCODE_UP ||
-                           evt.key.keysym.scancode == SDL_SCANCODE_DOWN) {  //vertical powerful slide
-                    for (uint32_t column = 0; column < board_size.x; ++column) {
-                        uint32_t row = 0;
-                        Piece prevPiece = Empty;
-                        while (prevPiece == Empty && row < board_size.y) {  //find first non-Empty piece
-                            prevPiece = board_state[row++][column];
-                        }
-                        for (; row < board_size.y; ++row) {
-                            checkPiece(prevPiece, row, column);
-                        }
-                    }
-                }
-            }
-        }
-
-        {  //slide
-            //for directions should be handled in four different indexing
+        {  //slide; holding shift makes it a powerful slide (remove duplicate objects in the same row/column first)
+            bool powerful = (evt.key.keysym.mod == KMOD_LSHIFT || evt.key.keysym.mod == KMOD_RSHIFT);
+            Board::Move move;
             if (evt.key.keysym.scancode == SDL_SCANCODE_LEFT) {
-                for (uint32_t r = 0; r < board_size.y; ++r) {
-                    uint32_t head = 0;
-                    while (board_state[r][head] != Empty && head < board_size.x) {  //find first Empty position
-                        ++head;
-                    }
-                    for (uint32_t c = head + 1; c < board_size.x; ++c) {
-                        if (board_state[r][c] != Empty && c != head && board_state[r][head] == Empty) {
-                            std::swap(board_state[r][head++], board_state[r][c]);
-                        }
-                    }
-                }
-                return true;
+                move = (powerful ? Board::PowerLeft : Board::Left);
             } else if (evt.key.keysym.scancode == SDL_SCANCODE_RIGHT) {
-                for (uint32_t r = board_size.y; r-- > 0; ) {  //unsigned reverse traverse
-                    uint32_t head = board_size.x - 1;
-                    while (board_state[r][head] != Empty && head > 0) {
-                        --head;
-                    }
-                    for (uint32_t c = head; c-- > 0; ) {
-                        if (board_state[r][c] != Empty && c != head && board_state[r][head] == Empty) {
-                            std::swap(board_state[r][head--], board_state[r][c]);
-                        }
-                    }
-                }
-                return true;
+                move = (powerful ? Board::PowerRight : Board::Right);
             } else if (evt.key.keysym.scancode == SDL_SCANCODE_UP) {
-                for (uint32_t c = 0; c < board_size.x; ++c) {
-                    uint32_t head = 0;
-                    while (board_state[head][c] != Empty && head < board_size.y) {
-                        ++head;
-                    }
-                    for (uint32_t r = head + 1; r < board_size.y; ++r) {
-                        if (board_state[r][c] != Empty && r != head && board_state[head][c] == Empty) {
-                            std::swap(board_state[head++][c], board_state[r][c]);
-                        }
-                    }
-                }
-                return true;
+                move = (powerful ? Board::PowerUp : Board::Up);
             } else if (evt.key.keysym.scancode == SDL_SCANCODE_DOWN) {
-                for (uint32_t c = board_size.x; c-- > 0; ) {
-                    uint32_t head = board_size.y - 1;
-                    while (board_state[head][c] != Empty && head > 0) {
-                        --head;
-                    }
-                    for (uint32_t r = head; r-- > 0; ) {
-                        if (board_state[r][c] != Empty && r != head && board_state[head][c] == Empty) {
-                            std::swap(board_state[head--][c], board_state[r][c]);
-                        }
-                    }
-                }
-                return true;
+                move = (powerful ? Board::PowerDown : Board::Down);
+            } else {
+                return false;
             }
+            if (board.apply(move)) {
+                pieces_stale = true;  //(the board texture is updated from board's touched lines)
+            }
+            return true;
         }
 	}
+
+	//camera: mouse wheel zooms about the cursor, dragging with the left button pans:
+	float aspect = float(window_size.x) / float(window_size.y);
+	float world_per_pixel = 2.0f / (view_scale(aspect) * float(window_size.y));
+	if (evt.type == SDL_MOUSEBUTTONDOWN && evt.button.button == SDL_BUTTON_LEFT) {
+		camera.dragging = true;
+		return true;
+	} else if (evt.type == SDL_MOUSEBUTTONUP && evt.button.button == SDL_BUTTON_LEFT) {
+		camera.dragging = false;
+		return true;
+	} else if (evt.type == SDL_MOUSEMOTION) {
+		camera.mouse = glm::vec2(evt.motion.x, evt.motion.y);
+		if (camera.dragging) {
+			camera.center -= world_per_pixel * glm::vec2(evt.motion.xrel, -evt.motion.yrel);
+			camera.center = glm::clamp(camera.center, glm::vec2(0.0f), glm::vec2(board_size));
+			view_stale = true;
+			return true;
+		}
+	} else if (evt.type == SDL_MOUSEWHEEL && evt.wheel.y != 0) {
+		//world position under the cursor, which should stay put:
+		glm::vec2 from_center = world_per_pixel * glm::vec2(camera.mouse.x - 0.5f * window_size.x, 0.5f * window_size.y - camera.mouse.y);
+		glm::vec2 anchor = camera.center + from_center;
+
+		//zoom out to a bit smaller than the whole board, or in until about four cells fill the window:
+		float max_zoom = glm::max(1.0f, 0.25f * float(glm::max(board_size.x, board_size.y)));
+		float zoom = glm::clamp(camera.zoom * std::pow(1.2f, float(evt.wheel.y)), 0.5f, max_zoom);
+
+		camera.center = anchor - from_center * (camera.zoom / zoom);
+		camera.center = glm::clamp(camera.center, glm::vec2(0.0f), glm::vec2(board_size));
+		camera.zoom = zoom;
+		view_stale = true;
+		return true;
+	}
 	return false;
 }
 
-void Game::update(float elapsed) {
-    //update positions of black/white pieces based on board_state
-    uint32_t blackIdx = 0;
-    uint32_t whiteIdx = 0;
-    for (uint32_t row = 0; row < board_size.y; ++row) {
-        for (uint32_t column = 0; column < board_size.x; ++column) {
-            if (board_state[row][column] == Black) {  // blackpieces
-                blackpieces[blackIdx].x = column;
-                blackpieces[blackIdx].y = board_size.y - 1 - row;
-                ++blackIdx;
-            } else if (board_state[row][column] == White) {  // whitepieces
-                whitepieces[whiteIdx].x = column;
-                whitepieces[whiteIdx].y = board_size.y - 1 - row;
-                ++whiteIdx;
+void Game::update(float /*elapsed*/) {
+    //nothing here depends on time, so there is only work to do after the board changes:
+    if (!pieces_stale) return;
+    pieces_stale = false;
+
+    //update positions of black/white pieces based on the board (the board texture program finds them itself)
+    if (render_mode == RenderInstanced) {
+        blackpieces.clear();
+        whitepieces.clear();
+        for (uint32_t row = 0; row < board_size.y; ++row) {
+            for (uint32_t column = 0; column < board_size.x; ++column) {
+                if (board.at(row, column) == Board::Black) {  // blackpieces
+                    blackpieces.emplace_back(column, board_size.y - 1 - row);
+                } else if (board.at(row, column) == Board::White) {  // whitepieces
+                    whitepieces.emplace_back(column, board_size.y - 1 - row);
+                }
             }
         }
+        draw_list_stale = true;
     }
-    blackpieces.resize(blackIdx);
-    whitepieces.resize(whiteIdx);
 
     // check if player wins
-    if (blackpieces.size() == 1 && whitepieces.size() == 1) {
+    if (board.is_win()) {
         game_state = Win;
     }
 }
 
-void Game::draw(glm::uvec2 drawable_size) {
-	//Set up a transformation matrix to fit the board in the window:
-	glm::mat4 world_to_clip;
-	{
-		float aspect = float(drawable_size.x) / float(drawable_size.y);
-
-		//want scale such that board * scale fits in [-aspect,aspect]x[-1.0,1.0] screen box:
-		float scale = glm::min(
-			2.0f * aspect / float(board_size.x),
-			2.0f / float(board_size.y)
-		);
-
-		//center of board will be placed at center of screen:
-		glm::vec2 center = 0.5f * glm::vec2(board_size);
-
-		//NOTE: glm matrices are specified in column-major order
-		world_to_clip = glm::mat4(
-			scale / aspect, 0.0f, 0.0f, 0.0f,
-			0.0f, scale, 0.0f, 0.0f,
-			0.0f, 0.0f,-1.0f, 0.0f,
-			-(scale / aspect) * center.x, -scale * center.y, 0.0f, 1.0f
-		);
-	}
-
-	//set up graphics pipeline to use data from the meshes and the simple shading program:
-	glBindVertexArray(meshes_for_simple_shading_vao);
-	glUseProgram(simple_shading.program);
-
-	glUniform3fv(simple_shading.sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.81f, 0.81f, 0.76f)));
-	glUniform3fv(simple_shading.sun_direction_vec3, 1, glm::value_ptr(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f))));
-	glUniform3fv(simple_shading.sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-	glUniform3fv(simple_shading.sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
-
-	//helper function to draw a given mesh with a given transformation:
-	auto draw_mesh = [&](Mesh const &mesh, glm::mat4 const &object_to_world) {
-		//set up the matrix uniforms:
-		if (simple_shading.object_to_clip_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * object_to_world;
-			glUniformMatrix4fv(simple_shading.object_to_clip_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
-		}
-		if (simple_shading.object_to_light_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(simple_shading.object_to_light_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_world));
-		}
-		if (simple_shading.normal_to_light_mat3 != -1U) {
-			//NOTE: if there isn't any non-uniform scaling in the object_to_world matrix, then the inverse transpose is the matrix itself, and computing it wastes some CPU time:
-			glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(object_to_world)));
-			glUniformMatrix3fv(simple_shading.normal_to_light_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_world));
-		}
-
-		//draw the mesh:
-		glDrawArrays(GL_TRIANGLES, mesh.first, mesh.count);
+bool Game::animating() const {
+    //nothing moves on its own (slides are instant), but a new stage needs an update before it shows up,
+    //and tile chunks that weren't baked yet should replace the fallback tile layer soon:
+    return pieces_stale || tile_chunks_pending;
+}
+
+float Game::view_scale(float aspect) const {
+	//at zoom 1, want scale such that board * scale fits in [-aspect,aspect]x[-1.0,1.0] screen box:
+	return camera.zoom * glm::min(
+		2.0f * aspect / float(board_size.x),
+		2.0f / float(board_size.y)
+	);
+}
+
+void Game::set_view(glm::uvec2 drawable_size) {
+	view_size = drawable_size;
+	view_stale = false;
+
+	//Set up a transformation matrix to show the board around the camera center:
+	float aspect = float(drawable_size.x) / float(drawable_size.y);
+	float scale = view_scale(aspect);
+	glm::vec2 center = camera.center;
+
+	//NOTE: glm matrices are specified in column-major order
+	scene.world_to_clip = glm::mat4(
+		scale / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, scale, 0.0f, 0.0f,
+		0.0f, 0.0f,-1.0f, 0.0f,
+		-(scale / aspect) * center.x, -scale * center.y, 0.0f, 1.0f
+	);
+
+	gl_state.bind_buffer(GL_UNIFORM_BUFFER, scene_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, offsetof(Scene, world_to_clip), sizeof(scene.world_to_clip), glm::value_ptr(scene.world_to_clip));
+
+	{ //find the cells in view (with a cell of margin, since pieces may reach a bit past their cell):
+		glm::vec2 half = glm::vec2(aspect, 1.0f) / scale;
+		glm::ivec2 min = glm::ivec2(glm::floor(center - half)) - glm::ivec2(1);
+		glm::ivec2 max = glm::ivec2(glm::ceil(center + half)) + glm::ivec2(1);
+		min = glm::clamp(min, glm::ivec2(0), glm::ivec2(board_size));
+		max = glm::clamp(max, glm::ivec2(0), glm::ivec2(board_size));
+		if (glm::uvec2(min) != visible_min || glm::uvec2(max) != visible_max) {
+			visible_min = glm::uvec2(min);
+			visible_max = glm::uvec2(max);
+			draw_list_stale = true;
+		}
+	}
+
+	{ //pick the pieces' level of detail from how many pixels a cell covers:
+		float cell_pixels = 0.5f * scale * float(drawable_size.y);
+		uint32_t impostor = uint32_t(blackpiece_lods.size()) - 1;
+		uint32_t lod = 0;
+		if (cell_pixels < ImpostorPixels) {
+			lod = impostor;
+		} else {
+			//level l + 1 is used once cells are smaller than lod_pixels[l], down to the coarsest mesh:
+			static const float lod_pixels[MaxPieceLods - 1] = { 48.0f, 20.0f, 10.0f };
+			while (lod + 1 < impostor && cell_pixels < lod_pixels[lod]) ++lod;
+		}
+		if (lod != piece_lod) {
+			piece_lod = lod;
+			draw_list_stale = true;
+		}
+	}
+
+	{ //find the tile chunks in view:
+		visible_tile_chunks.clear();
+		uint32_t chunks_x = (board_size.x + TileChunkSize - 1) / TileChunkSize;
+		glm::uvec2 first = visible_min / TileChunkSize;
+		glm::uvec2 last = (visible_max + glm::uvec2(TileChunkSize - 1)) / TileChunkSize;
+		for (uint32_t cy = first.y; cy < last.y; ++cy) {
+			for (uint32_t cx = first.x; cx < last.x; ++cx) {
+				glm::uvec2 begin = glm::uvec2(cx, cy) * TileChunkSize;
+				glm::uvec2 end = glm::min(begin + glm::uvec2(TileChunkSize), board_size);
+				glm::vec3 min = glm::vec3(begin.x, begin.y, -0.5f) + 0.5f * glm::vec3(1.0f, 1.0f, 0.0f) + tile_min;
+				glm::vec3 max = glm::vec3(end.x - 1, end.y - 1, -0.5f) + 0.5f * glm::vec3(1.0f, 1.0f, 0.0f) + tile_max;
+				if (box_in_view(scene.world_to_clip, min, max)) {
+					visible_tile_chunks.emplace_back(cy * chunks_x + cx);
+				}
+			}
+		}
+	}
+}
+
+constexpr uint32_t Game::TileChunkSize;
+constexpr uint32_t Game::MaxTileChunks;
+constexpr uint32_t Game::MaxTileChunkBakes;
+
+Game::TileChunk &Game::tile_chunk(uint32_t index) {
+	auto f = tile_chunks.find(index);
+	if (f != tile_chunks.end()) return f->second;
+
+	//make room by dropping the chunk drawn longest ago:
+	while (tile_chunks.size() >= MaxTileChunks) {
+		auto oldest = tile_chunks.begin();
+		for (auto c = tile_chunks.begin(); c != tile_chunks.end(); ++c) {
+			if (c->second.last_drawn < oldest->second.last_drawn) oldest = c;
+		}
+		glDeleteVertexArrays(1, &oldest->second.vao);
+		glDeleteBuffers(1, &oldest->second.vbo);
+		gl_state.invalidate(); //(in case they were bound)
+		tile_chunks.erase(oldest);
+	}
+
+	//bake a copy of the tile mesh for every cell in the chunk:
+	uint32_t chunks_x = (board_size.x + TileChunkSize - 1) / TileChunkSize;
+	glm::uvec2 begin = glm::uvec2(index % chunks_x, index / chunks_x) * TileChunkSize;
+	glm::uvec2 end = glm::min(begin + glm::uvec2(TileChunkSize), board_size);
+	std::vector< Vertex > vertices;
+	vertices.reserve((end.x - begin.x) * (end.y - begin.y) * tile_vertices.size());
+	for (uint32_t y = begin.y; y < end.y; ++y) {
+		for (uint32_t x = begin.x; x < end.x; ++x) {
+			glm::vec3 offset = glm::vec3(x+0.5f, y+0.5f,-0.5f);
+			for (Vertex v : tile_vertices) {
+				v.Position += offset;
+				vertices.emplace_back(v);
+			}
+		}
+	}
+
+	TileChunk &chunk = tile_chunks[index];
+	chunk.count = GLsizei(vertices.size());
+
+	glGenBuffers(1, &chunk.vbo);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, chunk.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+
+	//positions are baked, so the Offset attribute is left disabled (draw sets its constant value to zero):
+	glGenVertexArrays(1, &chunk.vao);
+	gl_state.bind_vertex_array(chunk.vao);
+	glVertexAttribPointer(simple_shading.Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Position));
+	glEnableVertexAttribArray(simple_shading.Position_vec4);
+	if (simple_shading.Normal_vec3 != -1U) {
+		glVertexAttribPointer(simple_shading.Normal_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(simple_shading.Normal_vec3);
+	}
+	if (simple_shading.Color_vec4 != -1U) {
+		glVertexAttribPointer(simple_shading.Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Color));
+		glEnableVertexAttribArray(simple_shading.Color_vec4);
+	}
+
+	return chunk;
+}
+
+void Game::build_draw_list() {
+	draw_list_stale = false;
+	draw_list.clear();
+
+	//only cells in view are drawn:
+	glm::uvec2 visible = visible_max - visible_min;
+
+	if (render_mode == RenderTexture) {
+		//one instance per visible cell for every layer; the vertex shader drops the cells that don't match:
+		GLsizei cells = GLsizei(visible.x * visible.y);
+		if (cells == 0) return;
+		gl_state.use_program(board_texture_shading.program);
+		glUniform2i(board_texture_shading.first_cell_ivec2, visible_min.x, visible_min.y);
+		glUniform1i(board_texture_shading.columns_int, visible.x);
+		auto layer = [&](Mesh const &mesh, Board::Piece piece, float z) {
+			DrawRecord record;
+			record.mesh = &mesh;
+			record.instances = cells;
+			record.piece = piece;
+			record.z = z;
+			draw_list.emplace_back(record);
+		};
+		layer(tile_mesh, Board::Empty, -0.5f);
+		layer(blackpiece_lods[piece_lod], Board::Black, 0.0f);
+		layer(whitepiece_lods[piece_lod], Board::White, 0.0f);
+		return;
+	}
+
+	//gather the offset of every visible tile and piece; each layer is one contiguous run of instances:
+	instance_offsets.clear();
+	GLint first = 0;
+	auto layer = [&](Mesh const &mesh) { //draw the offsets added since the last layer
+		DrawRecord record;
+		record.mesh = &mesh;
+		record.first_instance = first;
+		record.instances = GLsizei(instance_offsets.size()) - first;
+		if (record.instances > 0) draw_list.emplace_back(record);
+		first = GLint(instance_offsets.size());
 	};
+	Mesh const &blackpiece = blackpiece_lods[piece_lod];
+	Mesh const &whitepiece = whitepiece_lods[piece_lod];
+	auto in_view = [this](glm::uvec2 const &cell) {
+		return cell.x >= visible_min.x && cell.x < visible_max.x && cell.y >= visible_min.y && cell.y < visible_max.y;
+	};
+	for (uint32_t y = visible_min.y; y < visible_max.y; ++y) {
+		for (uint32_t x = visible_min.x; x < visible_max.x; ++x) {
+			instance_offsets.emplace_back(x+0.5f, y+0.5f,-0.5f);
+		}
+	}
+	layer(tile_mesh);
+	for (auto const &b : blackpieces) {
+		if (in_view(b)) instance_offsets.emplace_back(b.x+0.5f, b.y+0.5f, 0.0f);
+	}
+	layer(blackpiece);
+	for (auto const &w : whitepieces) {
+		if (in_view(w)) instance_offsets.emplace_back(w.x+0.5f, w.y+0.5f, 0.0f);
+	}
+	layer(whitepiece);
 
-	for (uint32_t y = 0; y < board_size.y; ++y) {
-		for (uint32_t x = 0; x < board_size.x; ++x) {
-			draw_mesh(tile_mesh,
-				glm::mat4(
-					1.0f, 0.0f, 0.0f, 0.0f,
-					0.0f, 1.0f, 0.0f, 0.0f,
-					0.0f, 0.0f, 1.0f, 0.0f,
-					x+0.5f, y+0.5f,-0.5f, 1.0f
-				)
-			);
-		}
-	}
-    for (auto& b : blackpieces) {
-        draw_mesh(blackpiece_mesh,
-            glm::mat4(
-                1.0f, 0.0f, 0.0f, 0.0f,
-                0.0f, 1.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 1.0f, 0.0f,
-                b.x+0.5f, b.y+0.5f, 0.0f, 1.0f
-            )
-        );
-    }
-    for (auto& w : whitepieces) {
-        draw_mesh(whitepiece_mesh,
-            glm::mat4(
-                1.0f, 0.0f, 0.0f, 0.0f,
-                0.0f, 1.0f, 0.0f, 0.0f,
-                0.0f, 0.0f, 1.0f, 0.0f,
-                w.x+0.5f, w.y+0.5f, 0.0f, 1.0f
-            )
-        );
-    }
+	//(written to a fresh part of the stream, so frames still in flight keep drawing the old offsets without a stall)
+	instance_base = instance_stream->write(instance_offsets.data(), instance_offsets.size() * sizeof(glm::vec3));
+}
+
+void Game::draw(glm::uvec2 drawable_size) {
+	//the view and draw list are only rebuilt when something changed, so drawing an unchanged board just replays them:
+	if (drawable_size != view_size || view_stale) set_view(drawable_size);
+	if (draw_list_stale) build_draw_list();
+
+	if (render_mode == RenderTexture) {
+		gl_state.bind_texture_2d(0, board_tex);
+		if (board_tex_stale || board.touched) {
+			static_assert(sizeof(Board::Piece) == 1, "cells are uploaded as bytes");
+			//upload the w x h block of cells with top-left cell (x,y):
+			auto upload = [this](uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+				glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &board.cells[y * board_size.x + x]);
+			};
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //rows of cells aren't padded
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, board_size.x); //so blocks narrower than the board step through it correctly
+			if (board_tex_stale) { //new stage; everything changed
+				upload(0, 0, board_size.x, board_size.y);
+				board_tex_stale = false;
+			} else { //only re-upload the lines moves touched, one block per run of adjacent lines
+				for_each_run(board.touched_rows, [&](uint32_t begin, uint32_t end){
+					upload(0, begin, board_size.x, end - begin);
+				});
+				for_each_run(board.touched_columns, [&](uint32_t begin, uint32_t end){
+					upload(begin, 0, end - begin, board_size.y);
+				});
+			}
+			board.clear_touched();
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+	}
+
+	//(the tile layer is drawn first, then the pieces; gpu_timer times the two passes separately)
+	gpu_timer.begin(GPUTimer::Tiles);
+
+	//draw the tile layer from baked chunks, unless there are too many in view to keep around:
+	bool chunked_tiles = (visible_tile_chunks.size() <= MaxTileChunks);
+	tile_chunks_pending = false;
+	if (chunked_tiles) {
+		++tile_chunk_clock;
+		//mark the baked chunks in view first, so baking the rest never drops one of them:
+		for (uint32_t index : visible_tile_chunks) {
+			auto f = tile_chunks.find(index);
+			if (f != tile_chunks.end()) f->second.last_drawn = tile_chunk_clock;
+		}
+		//bake only a few chunks per frame (one zoom out can bring dozens into view);
+		//until all of them are baked, the tile layer's draw record is used instead:
+		uint32_t bakes = 0;
+		for (uint32_t index : visible_tile_chunks) {
+			if (tile_chunks.count(index)) continue;
+			if (bakes == MaxTileChunkBakes) {
+				tile_chunks_pending = true;
+				break;
+			}
+			tile_chunk(index).last_drawn = tile_chunk_clock;
+			++bakes;
+		}
+		chunked_tiles = !tile_chunks_pending;
+	}
+	if (chunked_tiles) {
+		gl_state.use_program(simple_shading.program);
+		glVertexAttrib3f(simple_shading.Offset_vec3, 0.0f, 0.0f, 0.0f);
+		for (uint32_t index : visible_tile_chunks) {
+			TileChunk &chunk = tile_chunk(index);
+			gl_state.bind_vertex_array(chunk.vao);
+			glDrawArrays(GL_TRIANGLES, 0, chunk.count);
+		}
+	}
 
+	//set up graphics pipeline to use data from the meshes and the program for the render mode
+	//(this is left bound afterward, so on most frames gl_state skips all of it):
+	if (render_mode == RenderTexture) {
+		gl_state.bind_vertex_array(meshes_for_board_texture_shading_vao);
+		gl_state.use_program(board_texture_shading.program);
+	} else {
+		gl_state.bind_vertex_array(meshes_for_simple_shading_vao);
+		gl_state.use_program(simple_shading.program);
+		gl_state.bind_buffer(GL_ARRAY_BUFFER, instance_stream->buffer);
+	}
 
-	glUseProgram(0);
+	bool timing_pieces = false;
+	for (DrawRecord const &record : draw_list) {
+		if (chunked_tiles && record.mesh == &tile_mesh) continue;
+		if (record.mesh != &tile_mesh && !timing_pieces) {
+			gpu_timer.begin(GPUTimer::Pieces);
+			timing_pieces = true;
+		}
+		if (render_mode == RenderTexture) {
+			glUniform1ui(board_texture_shading.piece_uint, record.piece);
+			glUniform1f(board_texture_shading.z_float, record.z);
+		} else {
+			//(GL 3.3 has no base instance parameter, so move the start of the offset attribute instead)
+			glVertexAttribPointer(simple_shading.Offset_vec3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLbyte *)0 + instance_base + record.first_instance * sizeof(glm::vec3));
+		}
+		if (record.mesh->index_count) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, record.mesh->index_count, GL_UNSIGNED_INT, (GLbyte *)0 + record.mesh->index_first * sizeof(uint32_t), record.instances, record.mesh->first);
+		} else {
+			glDrawArraysInstanced(GL_TRIANGLES, record.mesh->first, record.mesh->count, record.instances);
+		}
+	}
+
+	gpu_timer.end();
+
+	//(lets instance_stream reuse space once the GPU is done with this frame)
+	instance_stream->end_frame();
 
 	GL_ERRORS();
 }
 
 void Game::generate_new_stage() {
-    { //set positions of pieces
-        blackpieces.clear();
-        whitepieces.clear();
-        for (uint32_t r = 0; r < board_size.y; ++r) {
-            for (uint32_t c = 0; c < board_size.x; ++c) {
-                auto piece = mt() % 3;  //Empty, Black, White
-                if (piece == White) {
-                    whitepieces.emplace_back(glm::vec2(r,c));
-                } else if (piece == Black) {
-                    blackpieces.emplace_back(glm::vec2(r,c));
-                }
-            }
-        }
-    }
+    generate_new_stage(stage_moves.x, stage_moves.y);
+}
 
-    { //set board_state
-        memset(board_state, Empty, sizeof(board_state));  //zero-out the board_state
-        auto set_board_state = [&] (std::vector< glm::uvec2 >& piece_pos, Piece piece) {
-            for (auto& p : piece_pos) {
-                board_state[board_size.y - 1 - p.y][p.x] = piece;
-            }
-        };
-        set_board_state(blackpieces, Black);
-        set_board_state(whitepieces, White);
+void Game::generate_new_stage(uint32_t min_moves, uint32_t max_moves) {
+    //re-draw if a board comes out invalid or already won; a bounded number of times, in case the board size makes that likely:
+    for (uint32_t attempt = 0; attempt < 64; ++attempt) {
+        pick_stage(min_moves, max_moves);
+        if (board.count(Board::Black) >= 1 && board.count(Board::White) >= 1 && !board.is_win()) break;
+        if (attempt + 1 == 64) {
+            std::cerr << "WARNING: couldn't generate a valid " << board_size.x << "x" << board_size.y << " stage." << std::endl;
+        }
     }
 
     { //set game_state
         game_state = GoOn;
+        pieces_stale = board_tex_stale = true;
     }
+}
+
+void Game::pick_stage(uint32_t min_moves, uint32_t max_moves) {
+    //wait this long for the background worker before filling the board at random instead:
+    const std::chrono::milliseconds WorkerTimeout(250);
 
-    //re-generate the game if current board is invalid
-    if (whitepieces.size() < 1 || blackpieces.size() < 1) {
-        generate_new_stage();
+    if (stage_corpus || stage_worker) {
+        //draw rated stages until one turns up whose symmetry class (rotations, mirrors, color swap) wasn't served before;
+        //give up after a few draws, in case nearly every stage in range has been seen:
+        for (uint32_t draws = 0; ; ++draws) {
+            uint64_t code = 0, hash = 0;
+            if (stage_corpus) { //sample a pre-rated stage
+                uint64_t index = 0;
+                stage_corpus->sample(min_moves, max_moves, rng(), &index, &stage_optimal_moves);
+                //the corpus keeps one board per symmetry class, so show it in a random orientation and coloring:
+                code = stage_solver->transform(stage_corpus->boards[index], uint32_t(rng.below(stage_solver->symmetries())));
+                hash = stage_corpus->hashes[index];
+            } else { //take a rated stage from the background worker
+                stage_worker->set_range(min_moves, max_moves);
+                StageWorker::Stage stage;
+                //skip stages rated for an earlier range (at most one ring's worth, in case the range can't be met);
+                //the ring is only empty right after startup or when stages are requested very quickly:
+                bool popped = false;
+                for (uint32_t skipped = 0; ; ) {
+                    if (wait_for_stages) {
+                        stage_worker->pop_wait(&stage);
+                        popped = true;
+                    } else {
+                        popped = stage_worker->pop(&stage, WorkerTimeout);
+                    }
+                    if (!popped || (stage.moves >= min_moves && stage.moves <= max_moves) || ++skipped > 16) break;
+                }
+                if (!popped) {
+                    std::cerr << "NOTE: stage worker is slow; using a random stage." << std::endl;
+                    break;
+                }
+                code = stage.code;
+                hash = stage.hash;
+                stage_optimal_moves = stage.moves;
+            }
+            if (!seen_stages.contains(hash) || draws == 32) {
+                seen_stages.insert(hash);
+                board.unpack(code);
+                return;
+            }
+        }
     }
+
+    //board is too big to rate (or the worker had nothing ready); fill it at random:
+    stage_optimal_moves = 0;
+    static_assert(sizeof(Board::Piece) == 1 && Board::Empty == 0 && Board::Black == 1 && Board::White == 2, "cells are stored as ternary bytes");
+    rng.ternary(reinterpret_cast< uint8_t * >(board.cells.data()), board.cells.size());
 }
 
 
-//create and return an OpenGL vertex shader from source:
-static GLuint compile_shader(GLenum type, std::string const &source) {
+static void allow_parallel_shader_compile() {
+	//GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile have the same entry point (and enums), just renamed:
+	PFNGLMAXSHADERCOMPILERTHREADSARBPROC max_shader_compiler_threads = nullptr;
+	if (SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile")) {
+		max_shader_compiler_threads = reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSARBPROC >(SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR"));
+	} else if (SDL_GL_ExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		max_shader_compiler_threads = reinterpret_cast< PFNGLMAXSHADERCOMPILERTHREADSARBPROC >(SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB"));
+	}
+	//(0xffffffff lets the driver pick the number of threads)
+	if (max_shader_compiler_threads) max_shader_compiler_threads(0xffffffff);
+}
+
+//create an OpenGL shader from source and start compiling it (finish_program checks the result):
+static GLuint start_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
 	GLchar const *str = source.c_str();
 	GLint length = GLint(source.size());
 	glShaderSource(shader, 1, &str, &length);
 	glCompileShader(shader);
-	GLint compile_status = GL_FALSE;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-	if (compile_status != GL_TRUE) {
-		std::cerr << "Failed to compile shader." << std::endl;
+	return shader;
+}
+
+static PendingProgram start_program(std::string const &vertex_source, std::string const &fragment_source, ProgramCache *cache) {
+	PendingProgram pending;
+	pending.vertex_source = vertex_source;
+	pending.fragment_source = fragment_source;
+	if (cache) {
+		pending.program = cache->load(vertex_source, fragment_source);
+		if (pending.program) return pending;
+	}
+
+	pending.vertex_shader = start_shader(GL_VERTEX_SHADER, vertex_source);
+	pending.fragment_shader = start_shader(GL_FRAGMENT_SHADER, fragment_source);
+	pending.program = glCreateProgram();
+	if (cache) cache->prepare(pending.program); //(so the binary can be stored after linking)
+	glAttachShader(pending.program, pending.vertex_shader);
+	glAttachShader(pending.program, pending.fragment_shader);
+	glLinkProgram(pending.program);
+	return pending;
+}
+
+static GLuint finish_program(PendingProgram const &pending, ProgramCache *cache) {
+	if (pending.vertex_shader == 0) return pending.program; //(loaded from the cache, and already checked there)
+
+	//(this is the first query of the program, so it is where the wait for the compiler happens)
+	GLint link_status = GL_FALSE;
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &link_status);
+	if (link_status != GL_TRUE) {
+		//report the shader that failed to compile, if any, otherwise the link failure:
+		for (GLuint shader : { pending.vertex_shader, pending.fragment_shader }) {
+			GLint compile_status = GL_FALSE;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+			if (compile_status == GL_TRUE) continue;
+			std::cerr << "Failed to compile shader." << std::endl;
+			GLint info_log_length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+			std::vector< GLchar > info_log(info_log_length, 0);
+			GLsizei length = 0;
+			glGetShaderInfoLog(shader, GLsizei(info_log.size()), &length, &info_log[0]);
+			std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
+		}
+		std::cerr << "Failed to link shader program." << std::endl;
 		GLint info_log_length = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
+		glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &info_log_length);
 		std::vector< GLchar > info_log(info_log_length, 0);
 		GLsizei length = 0;
-		glGetShaderInfoLog(shader, GLsizei(info_log.size()), &length, &info_log[0]);
+		glGetProgramInfoLog(pending.program, GLsizei(info_log.size()), &length, &info_log[0]);
 		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		glDeleteShader(shader);
-		throw std::runtime_error("Failed to compile shader.");
+		glDeleteShader(pending.vertex_shader);
+		glDeleteShader(pending.fragment_shader);
+		glDeleteProgram(pending.program);
+		throw std::runtime_error("failed to link program");
 	}
-	return shader;
+
+	//shaders are reference counted so this makes sure they are freed after program is deleted:
+	glDeleteShader(pending.vertex_shader);
+	glDeleteShader(pending.fragment_shader);
+
+	if (cache) cache->store(pending.vertex_source, pending.fragment_source, pending.program);
+	return pending.program;
 }
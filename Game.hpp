@@ -1,22 +1,48 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Board.hpp"
+#include "StageWorker.hpp"
+#include "Corpus.hpp"
+#include "Rng.hpp"
+#include "BloomFilter.hpp"
+#include "StreamBuffer.hpp"
 
 #include <SDL.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <vector>
-#include <random>
-#include <chrono>
+#include <memory>
+#include <unordered_map>
 
 // The 'Game' struct holds all of the game-relevant state,
 // and is called by the main loop.
 
 struct Game {
+	//how the board is drawn:
+	enum RenderMode {
+		RenderInstanced, //tiles come from baked vertex buffers; piece offsets are gathered on the CPU and streamed only when pieces move or the view or detail level changes
+		RenderTexture, //board state lives in a texture; the vertex shader places or culls every cell
+	};
+
+	//settings fixed for the lifetime of a Game:
+	struct Settings {
+		uint64_t seed = 0; //seeds the random engine, so the same seed gives the same stages
+		glm::uvec2 board_size = glm::uvec2(4,4);
+		RenderMode render_mode = RenderInstanced;
+		//multiply the (static) lighting into mesh vertex colors at load time, and draw with a pass-through fragment shader:
+		bool baked_lighting = false;
+		//load and save the stages served in earlier sessions (user_path("seen-stages.bloom")), so they aren't repeated;
+		// off for benchmarks, whose stages should only depend on the seed:
+		bool remember_stages = true;
+		//wait as long as it takes for the background worker's rated stages, instead of using a random stage after a short wait:
+		bool wait_for_stages = false;
+	};
+
 	//Game creates OpenGL resources (i.e. vertex buffer objects) in its
 	//constructor and frees them in its destructor.
-	Game();
+	Game(Settings const &settings);
 	~Game();
 
 	//handle_event is called when new mouse or keyboard events are received:
@@ -30,58 +56,183 @@ struct Game {
 	//draw is called after update:
 	void draw(glm::uvec2 drawable_size);
 
-    //generate new stage
+	//true if the next update+draw will change what's on screen even without new input
+	// (the main loop's on-demand mode keeps drawing frames while this is true):
+	bool animating() const;
+
+    //generate new stage whose optimal solution takes between min_moves and max_moves moves:
+    void generate_new_stage(uint32_t min_moves, uint32_t max_moves);
+    //...or within the stage_moves range:
     void generate_new_stage();
+    //puts one candidate stage on the board (generate_new_stage checks it and tries again if it's invalid or won):
+    void pick_stage(uint32_t min_moves, uint32_t max_moves);
 
 
 	//------- opengl resources -------
 
+	//camera and lighting constants, shared by every program through the "Scene" uniform block:
+	struct Scene { //std140 layout, so each vec3 takes the space of a vec4
+		glm::mat4 world_to_clip;
+		glm::vec4 sun_direction; //xyz used
+		glm::vec4 sun_color;
+		glm::vec4 sky_direction;
+		glm::vec4 sky_color;
+	};
+	static_assert(sizeof(Scene) == 128, "Scene should match the std140 layout.");
+	Scene scene;
+	GLuint scene_ubo = -1U; //uniform buffer holding scene, bound at SceneBinding
+	static constexpr GLuint SceneBinding = 0;
+
 	//shader program that draws lit objects with vertex colors:
 	struct {
 		GLuint program = -1U; //program object
 
-		//uniform locations:
-		GLuint object_to_clip_mat4 = -1U;
-		GLuint object_to_light_mat4x3 = -1U;
-		GLuint normal_to_light_mat3 = -1U;
-		GLuint sun_direction_vec3 = -1U;
-		GLuint sun_color_vec3 = -1U;
-		GLuint sky_direction_vec3 = -1U;
-		GLuint sky_color_vec3 = -1U;
+		//uniform locations (camera and lighting come from the Scene block instead):
 
 		//attribute locations:
 		GLuint Position_vec4 = -1U;
 		GLuint Normal_vec3 = -1U;
 		GLuint Color_vec4 = -1U;
+		GLuint Offset_vec3 = -1U; //per-instance
 	} simple_shading;
 
 	//mesh data, stored in a vertex buffer:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+	};
+	static_assert(sizeof(Vertex) == 28, "Vertex should be packed.");
 	GLuint meshes_vbo = -1U; //vertex buffer holding mesh data
 
 	//The location of each mesh in the meshes vertex buffer:
 	struct Mesh {
 		GLint first = 0;
 		GLsizei count = 0;
+		//if index_count is nonzero, the mesh is drawn from index_count indices (relative to 'first')
+		// starting at index_first in meshes_ibo, instead of as count vertices:
+		GLuint index_first = 0;
+		GLsizei index_count = 0;
 	};
+	GLuint meshes_ibo = -1U; //index buffer holding mesh indices (only if the blob was baked by bake-meshes)
 
     Mesh tile_mesh;
     Mesh blackpiece_mesh;
     Mesh whitepiece_mesh;
 
-	GLuint meshes_for_simple_shading_vao = -1U; //vertex array object that describes how to connect the meshes_vbo to the simple_shading_program
+	//levels of detail for the pieces, finest (the meshes above) first; coarser meshes come from
+	// "blackpiece.lod1", "blackpiece.lod2", ... entries if the blob has them, and the last level is always
+	// a flat quad ("impostor") generated at load time, used when a cell covers fewer than ImpostorPixels pixels:
+	static constexpr uint32_t MaxPieceLods = 4; //meshes, not counting the impostor
+	static constexpr float ImpostorPixels = 6.0f;
+	std::vector< Mesh > blackpiece_lods, whitepiece_lods;
+	uint32_t piece_lod = 0; //level drawn in the current view; chosen by set_view
+
+	//per-instance offsets for the tiles, black pieces and white pieces in draw_list,
+	// written to instance_stream at instance_base whenever draw_list is rebuilt:
+	std::unique_ptr< StreamBuffer > instance_stream;
+	GLintptr instance_base = 0;
+	std::vector< glm::vec3 > instance_offsets;
+
+	GLuint meshes_for_simple_shading_vao = -1U; //vertex array object that describes how to connect the meshes_vbo and instance_stream to the simple_shading_program
+
+	//shader program that draws one instance of a mesh per board cell, reading the cell from board_tex:
+	struct {
+		GLuint program = -1U; //program object
+
+		//uniform locations (camera and lighting come from the Scene block instead):
+		GLuint board_usampler2D = -1U;
+		GLuint piece_uint = -1U; //only cells holding this piece are drawn (Board::Empty draws every cell)
+		GLuint z_float = -1U; //height of the drawn layer
+		GLuint first_cell_ivec2 = -1U; //lower-left cell in view
+		GLuint columns_int = -1U; //width of the view, in cells
+
+		//attribute locations:
+		GLuint Position_vec4 = -1U;
+		GLuint Normal_vec3 = -1U;
+		GLuint Color_vec4 = -1U;
+	} board_texture_shading;
+
+	GLuint board_tex = -1U; //one GL_R8UI texel per cell, holding a Board::Piece; texel row 0 is board row 0
+
+	GLuint meshes_for_board_texture_shading_vao = -1U; //vertex array object that connects the meshes_vbo to the board_texture_shading program
+
+	//tiles never move, so the tile layer is drawn from static vertex buffers, each holding the tiles of
+	// one TileChunkSize x TileChunkSize block of cells. Chunks are baked the first time they are in view,
+	// at most MaxTileChunkBakes per frame, and at most MaxTileChunks (about 1.5MB each) are kept, dropping
+	// the least recently drawn. While some chunk in view isn't baked yet, or if more than MaxTileChunks are
+	// in view at once, the tile layer is drawn like the other layers instead:
+	static constexpr uint32_t TileChunkSize = 32;
+	static constexpr uint32_t MaxTileChunks = 64;
+	static constexpr uint32_t MaxTileChunkBakes = 4;
+	struct TileChunk {
+		GLuint vbo = -1U;
+		GLuint vao = -1U; //connects vbo to simple_shading (with Offset disabled)
+		GLsizei count = 0; //vertices
+		uint64_t last_drawn = 0; //tile_chunk_clock when last drawn
+	};
+	std::unordered_map< uint32_t, TileChunk > tile_chunks; //by chunk index (row-major over chunks)
+	std::vector< uint32_t > visible_tile_chunks; //found by set_view
+	uint64_t tile_chunk_clock = 0; //counts frames that draw chunks
+	bool tile_chunks_pending = false; //chunks in view are still waiting to be baked (so animating() keeps frames coming)
+	std::vector< Vertex > tile_vertices; //copy of the tile mesh
+	glm::vec3 tile_min, tile_max; //bounds of the tile mesh
+	TileChunk &tile_chunk(uint32_t index); //finds or bakes a chunk
+
+	//------- retained drawing -------
+	//draw() replays draw_list, which is only rebuilt after the pieces move,
+	//and scene.world_to_clip is only recomputed after the window is resized:
+	struct DrawRecord {
+		Mesh const *mesh = nullptr;
+		GLsizei instances = 0;
+		GLint first_instance = 0; //RenderInstanced: first offset after instance_base
+		Board::Piece piece = Board::Empty; //RenderTexture: only cells holding this piece are drawn (Empty draws all)
+		float z = 0.0f; //RenderTexture: height of the layer
+	};
+	std::vector< DrawRecord > draw_list;
+	bool draw_list_stale = true;
+	void build_draw_list();
+
+	glm::uvec2 view_size = glm::uvec2(0); //drawable size scene.world_to_clip was computed for
+	bool view_stale = true; //camera moved since set_view
+	void set_view(glm::uvec2 drawable_size);
+
+	//------- camera -------
+	//zoom 1 fits the whole board in the window; the mouse wheel zooms about the cursor and dragging pans:
+	struct {
+		glm::vec2 center = glm::vec2(0.0f); //world position in the middle of the window
+		float zoom = 1.0f;
+		bool dragging = false;
+		glm::vec2 mouse = glm::vec2(0.0f); //last cursor position (window pixels, y down)
+	} camera;
+	float view_scale(float aspect) const; //clip units per world unit
+
+	//cells in view, as [min,max) in (column, world y) with world y = board_size.y - 1 - row; found by set_view.
+	//Tiles and pieces outside this are never put in the draw list:
+	glm::uvec2 visible_min = glm::uvec2(0);
+	glm::uvec2 visible_max = glm::uvec2(0);
 
 	//------- game state -------
-    enum Piece { Empty, Black, White };
     enum GameState { Win, GoOn };
 
 	glm::uvec2 board_size = glm::uvec2(4,4);
-    Piece board_state[4][4];
+    Board board = Board(board_size);
     GameState game_state = GoOn;
-    std::mt19937 mt = std::mt19937(std::chrono::high_resolution_clock::now().time_since_epoch().count());  //random engine
-
-	std::vector< Mesh const * > board_meshes;
-	std::vector< glm::quat > board_rotations;
-    std::vector< glm::uvec2 > blackpieces, whitepieces;
+    RenderMode render_mode = RenderInstanced;
+    bool pieces_stale = true;  //set whenever the board changes; cleared by update
+    bool board_tex_stale = true;  //set when a new stage replaces the whole board (moves mark lines in board.touched_* instead); cleared by draw
+    Rng rng;  //random engine
+
+    glm::uvec2 stage_moves = glm::uvec2(3,6);  //[min,max] optimal solution length of generated stages
+    uint32_t stage_optimal_moves = 0;  //optimal solution length of the current stage (0 if not rated)
+    std::unique_ptr< Corpus > stage_corpus;  //pre-rated stages from dist/stages.corpus (null if missing or for another board size)
+    std::unique_ptr< Solver > stage_solver;  //used to show corpus stages in a random symmetry
+    BloomFilter seen_stages;  //canonical hashes of stages already served, saved between sessions
+    std::unique_ptr< StageWorker > stage_worker;  //rates stages in the background when there is no corpus (null if board_size is too big to rate)
+    bool remember_stages = true;  //see Settings
+    bool wait_for_stages = false;  //see Settings
+
+    std::vector< glm::uvec2 > blackpieces, whitepieces;  //piece positions, only kept up to date in RenderInstanced mode
 
 	struct {
 		bool roll_left = false;
@@ -0,0 +1,143 @@
+#include "ProgramCache.hpp"
+
+#include "read_chunk.hpp"
+#include "write_chunk.hpp"
+
+#include <SDL.h>
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+ProgramCache::ProgramCache(std::string const &filename_) : filename(filename_) {
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 1) || SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")) {
+		GetProgramBinary = reinterpret_cast< PFNGLGETPROGRAMBINARYPROC >(SDL_GL_GetProcAddress("glGetProgramBinary"));
+		ProgramBinary = reinterpret_cast< PFNGLPROGRAMBINARYPROC >(SDL_GL_GetProcAddress("glProgramBinary"));
+		ProgramParameteri = reinterpret_cast< PFNGLPROGRAMPARAMETERIPROC >(SDL_GL_GetProcAddress("glProgramParameteri"));
+	}
+	//some drivers have the functions but no binary formats to use with them:
+	GLint formats = 0;
+	if (GetProgramBinary && ProgramBinary && ProgramParameteri) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	supported = (formats > 0);
+	if (!supported) return;
+
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		GLubyte const *str = glGetString(name);
+		driver += (str ? reinterpret_cast< char const * >(str) : "?");
+		driver += '\n';
+	}
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) return; //(no cache yet)
+	try {
+		std::vector< char > file_driver;
+		read_chunk(file, "pcd0", &file_driver);
+		if (std::string(file_driver.begin(), file_driver.end()) != driver) {
+			std::cerr << "NOTE: shader cache '" << filename << "' is from another driver; rebuilding it." << std::endl;
+			return;
+		}
+		read_chunk(file, "pce0", &entries);
+		read_chunk(file, "pcb0", &binaries);
+		for (Entry const &e : entries) {
+			if (e.begin > e.end || e.end > binaries.size()) throw std::runtime_error("invalid binary range");
+		}
+	} catch (std::exception &e) {
+		std::cerr << "NOTE: ignoring damaged shader cache '" << filename << "' (" << e.what() << ")." << std::endl;
+		entries.clear();
+		binaries.clear();
+	}
+}
+
+uint64_t ProgramCache::hash(std::string const &vertex_source, std::string const &fragment_source) {
+	//64-bit FNV-1a over both sources (with a separator, so moving text between them changes the key):
+	uint64_t h = 0xcbf29ce484222325ULL;
+	auto add = [&h](char c) {
+		h = (h ^ uint8_t(c)) * 0x100000001b3ULL;
+	};
+	for (char c : vertex_source) add(c);
+	add('\0');
+	for (char c : fragment_source) add(c);
+	return h;
+}
+
+GLuint ProgramCache::load(std::string const &vertex_source, std::string const &fragment_source) {
+	if (!supported) return 0;
+	uint64_t key = hash(vertex_source, fragment_source);
+	auto f = std::find_if(entries.begin(), entries.end(), [key](Entry const &e) { return e.key == key; });
+	if (f == entries.end()) {
+		++misses;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	ProgramBinary(program, f->format, binaries.data() + f->begin, GLsizei(f->end - f->begin));
+	//drivers may reject their own binaries (e.g. after an update that kept the version string):
+	GLint link_status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	if (link_status != GL_TRUE) {
+		glDeleteProgram(program);
+		entries.erase(f);
+		dirty = true;
+		++misses;
+		return 0;
+	}
+	++hits;
+	return program;
+}
+
+void ProgramCache::prepare(GLuint program) {
+	if (!supported) return;
+	ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(std::string const &vertex_source, std::string const &fragment_source, GLuint program) {
+	if (!supported) return;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	Entry entry;
+	entry.key = hash(vertex_source, fragment_source);
+	entry.begin = uint32_t(binaries.size());
+	binaries.resize(binaries.size() + length);
+	GLenum format = 0;
+	GetProgramBinary(program, length, &length, &format, binaries.data() + entry.begin);
+	binaries.resize(entry.begin + length);
+	entry.end = uint32_t(binaries.size());
+	entry.format = format;
+
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&entry](Entry const &e) { return e.key == entry.key; }), entries.end());
+	entries.emplace_back(entry);
+	dirty = true;
+}
+
+void ProgramCache::save() {
+	if (!supported || !dirty) return;
+	dirty = false;
+
+	//drop the binaries of replaced entries:
+	std::vector< uint8_t > kept;
+	for (Entry &e : entries) {
+		uint32_t begin = uint32_t(kept.size());
+		kept.insert(kept.end(), binaries.begin() + e.begin, binaries.begin() + e.end);
+		e.begin = begin;
+		e.end = uint32_t(kept.size());
+	}
+	binaries.swap(kept);
+
+	try {
+		std::ofstream file(filename, std::ios::binary);
+		write_chunk(file, "pcd0", std::vector< char >(driver.begin(), driver.end()));
+		write_chunk(file, "pce0", entries);
+		write_chunk(file, "pcb0", binaries);
+	} catch (std::exception &e) {
+		//(the cache is only an optimization, so failing to write it isn't fatal)
+		std::cerr << "NOTE: couldn't write shader cache '" << filename << "' (" << e.what() << ")." << std::endl;
+	}
+}
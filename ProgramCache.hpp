@@ -0,0 +1,61 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 'ProgramCache' keeps linked program binaries (glGetProgramBinary, from GL 4.1
+// or GL_ARB_get_program_binary) in a file, so later launches can skip
+// compiling and linking shaders. Entries are keyed by a hash of the shader
+// sources, and the whole file is ignored if it was written by a different
+// driver (vendor, renderer or version string).
+//
+// The file is a sequence of chunks in the style of read_chunk.hpp:
+//  "pcd0" : characters; the driver string
+//  "pce0" : Entry records
+//  "pcb0" : bytes; the program binaries
+//
+// When binaries aren't supported, load() always misses and nothing is written.
+
+struct ProgramCache {
+	//reads 'filename' if it exists (a missing, stale or damaged file just means an empty cache):
+	ProgramCache(std::string const &filename);
+
+	//returns a linked program for these sources, or 0 if there isn't a usable one in the cache:
+	GLuint load(std::string const &vertex_source, std::string const &fragment_source);
+	//call on a program before linking it, so the driver keeps its binary around for store():
+	void prepare(GLuint program);
+	//adds a linked program to the cache (written by save()):
+	void store(std::string const &vertex_source, std::string const &fragment_source, GLuint program);
+	//writes the cache file if anything was stored:
+	void save();
+
+	std::string filename;
+	bool supported = false;
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+
+	struct Entry {
+		uint64_t key = 0; //see hash()
+		uint32_t format = 0; //binary format, as reported by glGetProgramBinary
+		uint32_t begin = 0; //range of the binary in 'binaries'
+		uint32_t end = 0;
+		uint32_t reserved = 0;
+	};
+	static_assert(sizeof(Entry) == 24, "Entry should be packed.");
+
+private:
+	std::string driver;
+	std::vector< Entry > entries;
+	std::vector< uint8_t > binaries;
+	bool dirty = false;
+
+	static uint64_t hash(std::string const &vertex_source, std::string const &fragment_source);
+
+	//looked up at runtime, since GL.hpp only declares GL 3.3:
+	PFNGLGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+	PFNGLPROGRAMBINARYPROC ProgramBinary = nullptr;
+	PFNGLPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+};
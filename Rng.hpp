@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 'Rng' is a small, fast random number generator (xoshiro256**) with an explicit
+// seed, so a stage sequence can be reproduced from its seed in benchmarks and
+// bug reports. It also satisfies UniformRandomBitGenerator, so it works with
+// the <random> distributions and std::shuffle.
+
+struct Rng {
+	Rng(uint64_t seed_ = 0) { seed(seed_); }
+
+	//reset the state from a 64-bit seed (expanded with splitmix64, as recommended for xoshiro):
+	void seed(uint64_t seed) {
+		for (uint32_t i = 0; i < 4; ++i) {
+			seed += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			s[i] = z ^ (z >> 31);
+		}
+	}
+
+	//next 64 random bits:
+	uint64_t operator()() {
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	//uniform integer in [0, bound), without the bias of '% bound' (Lemire's multiply-and-reject):
+	uint64_t below(uint64_t bound) {
+		uint64_t lo;
+		uint64_t hi = mul(operator()(), bound, &lo);
+		if (lo < bound) {
+			uint64_t threshold = (0 - bound) % bound;
+			while (lo < threshold) {
+				hi = mul(operator()(), bound, &lo);
+			}
+		}
+		return hi;
+	}
+
+	//advance the state by 2^128 steps; jumping copies of one generator
+	// gives non-overlapping streams for different threads:
+	void jump() {
+		static const uint64_t JUMP[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+		uint64_t t[4] = { 0, 0, 0, 0 };
+		for (uint32_t i = 0; i < 4; ++i) {
+			for (uint32_t b = 0; b < 64; ++b) {
+				if (JUMP[i] & (uint64_t(1) << b)) {
+					for (uint32_t j = 0; j < 4; ++j) t[j] ^= s[j];
+				}
+				operator()();
+			}
+		}
+		for (uint32_t j = 0; j < 4; ++j) s[j] = t[j];
+	}
+
+	//------- batched ternary values (board cells are Empty/Black/White) -------
+	//One 64-bit draw yields up to 40 uniform base-3 digits, since 3^40 < 2^64.
+
+	//fill 'count' bytes with uniform values in {0,1,2}:
+	void ternary(uint8_t *out, size_t count) {
+		while (count > 0) {
+			uint32_t digits = (count < 40 ? uint32_t(count) : 40);
+			uint64_t r = below(pow3(digits));
+			for (uint32_t i = 0; i < digits; ++i) {
+				out[i] = uint8_t(r % 3);
+				r /= 3;
+			}
+			out += digits;
+			count -= digits;
+		}
+	}
+
+	//a packed board (two bits per cell, see Board::pack) with each of 'cells' (at most 32) cells uniform in {0,1,2}:
+	uint64_t ternary_packed(uint32_t cells) {
+		//81 = 3^4, so each step converts four digits to a byte with one table lookup:
+		struct Table {
+			uint8_t packed[81];
+			Table() {
+				for (uint32_t v = 0; v < 81; ++v) {
+					packed[v] = uint8_t((v % 3) | ((v / 3 % 3) << 2) | ((v / 9 % 3) << 4) | ((v / 27) << 6));
+				}
+			}
+		};
+		static const Table table;
+
+		uint64_t r = below(pow3(cells));
+		uint64_t code = 0;
+		for (uint32_t c = 0; c < cells; c += 4) {
+			code |= uint64_t(table.packed[r % 81]) << (2 * c);
+			r /= 81;
+		}
+		return code;
+	}
+
+	//------- UniformRandomBitGenerator -------
+	typedef uint64_t result_type;
+	static constexpr uint64_t min() { return 0; }
+	static constexpr uint64_t max() { return ~uint64_t(0); }
+
+	uint64_t s[4];
+
+private:
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+	static uint64_t pow3(uint32_t n) {
+		uint64_t p = 1;
+		while (n--) p *= 3;
+		return p;
+	}
+	//full 64x64 -> 128 bit product; returns the high half:
+	static uint64_t mul(uint64_t a, uint64_t b, uint64_t *lo) {
+		#ifdef _MSC_VER
+		uint64_t hi;
+		*lo = _umul128(a, b, &hi);
+		return hi;
+		#else
+		unsigned __int128 p = (unsigned __int128)a * b;
+		*lo = uint64_t(p);
+		return uint64_t(p >> 64);
+		#endif
+	}
+};
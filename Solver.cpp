@@ -0,0 +1,207 @@
+#include "Solver.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+//mixing function from splitmix64, used to spread packed boards over hash slots:
+static inline uint64_t mix(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+uint64_t Solver::hash(uint64_t code) {
+	return mix(code);
+}
+
+Solver::Solver(glm::uvec2 size_) : size(size_) {
+	if (size.x * size.y > Board::MaxPackedCells || size.x > MaxLine || size.y > MaxLine) {
+		throw std::runtime_error("Solver only handles boards of at most 8x8 with at most 32 cells.");
+	}
+	row_table = make_line_table(size.x);
+	column_table = make_line_table(size.y);
+	to_columns = make_transpose_table(size);
+	to_rows = make_transpose_table(glm::uvec2(size.y, size.x));
+
+	{ //spatial symmetries: mirrors and half turn, plus transposes and quarter turns on square boards
+		uint32_t transforms = (size.x == size.y ? 8 : 4);
+		for (uint32_t t = 0; t < transforms; ++t) {
+			std::vector< uint8_t > perm(size.x * size.y);
+			for (uint32_t r = 0; r < size.y; ++r) {
+				for (uint32_t c = 0; c < size.x; ++c) {
+					uint32_t r2 = ((t & 1) ? size.y - 1 - r : r);
+					uint32_t c2 = ((t & 2) ? size.x - 1 - c : c);
+					if (t & 4) std::swap(r2, c2); //transpose (size.x == size.y here)
+					perm[r * size.x + c] = uint8_t(r2 * size.x + c2);
+				}
+			}
+			permutations.emplace_back(perm);
+		}
+	}
+	slots.resize(1024);
+	stamps.resize(slots.size(), 0);
+}
+
+Solver::LineTable Solver::make_line_table(uint32_t length) {
+	//run every possible line through the Board rules as a one-row board:
+	static const Board::Move moves[4] = { Board::Left, Board::Right, Board::PowerLeft, Board::PowerRight };
+	LineTable table;
+	uint32_t lines = 1 << (2 * length);
+	Board line(glm::uvec2(length, 1));
+	for (uint32_t m = 0; m < 4; ++m) {
+		table.results[m].resize(lines);
+		for (uint32_t code = 0; code < lines; ++code) {
+			line.unpack(code);
+			line.apply(moves[m]);
+			table.results[m][code] = uint16_t(line.pack());
+		}
+	}
+	return table;
+}
+
+std::vector< uint64_t > Solver::make_transpose_table(glm::uvec2 size) {
+	uint32_t rows = 1 << (2 * size.x);
+	std::vector< uint64_t > table(size.y * rows);
+	for (uint32_t r = 0; r < size.y; ++r) {
+		for (uint32_t row = 0; row < rows; ++row) {
+			uint64_t spread = 0;
+			for (uint32_t c = 0; c < size.x; ++c) {
+				spread |= uint64_t((row >> (2 * c)) & 3) << (2 * (c * size.y + r));
+			}
+			table[r * rows + row] = spread;
+		}
+	}
+	return table;
+}
+
+uint64_t Solver::transpose(uint64_t code, std::vector< uint64_t > const &table, glm::uvec2 size) {
+	uint32_t bits = 2 * size.x;
+	uint64_t mask = (uint64_t(1) << bits) - 1;
+	uint64_t ret = 0;
+	for (uint32_t r = 0; r < size.y; ++r) {
+		ret |= table[(r << bits) + ((code >> (r * bits)) & mask)];
+	}
+	return ret;
+}
+
+uint64_t Solver::apply_rows(uint64_t code, std::vector< uint16_t > const &table, glm::uvec2 size) {
+	uint32_t bits = 2 * size.x;
+	uint64_t mask = (uint64_t(1) << bits) - 1;
+	uint64_t ret = 0;
+	for (uint32_t r = 0; r < size.y; ++r) {
+		ret |= uint64_t(table[(code >> (r * bits)) & mask]) << (r * bits);
+	}
+	return ret;
+}
+
+uint64_t Solver::apply(uint64_t code, Board::Move move) const {
+	//Left/Up -> 0, Right/Down -> 1, PowerLeft/PowerUp -> 2, PowerRight/PowerDown -> 3:
+	uint32_t m = (move >= Board::PowerLeft ? 2 : 0) + ((move == Board::Right || move == Board::Down || move == Board::PowerRight || move == Board::PowerDown) ? 1 : 0);
+	bool horizontal = (move == Board::Left || move == Board::Right || move == Board::PowerLeft || move == Board::PowerRight);
+
+	if (horizontal) {
+		return apply_rows(code, row_table.results[m], size);
+	} else {
+		glm::uvec2 transposed_size(size.y, size.x);
+		uint64_t columns = transpose(code, to_columns, size);
+		columns = apply_rows(columns, column_table.results[m], transposed_size);
+		return transpose(columns, to_rows, transposed_size);
+	}
+}
+
+uint32_t Solver::count(uint64_t code, Board::Piece piece) {
+	//Black is 01 and White is 10, so look for the set bit with a clear partner:
+	const uint64_t low = 0x5555555555555555ULL;
+	uint64_t found = 0;
+	if (piece == Board::Black) found = code & ~(code >> 1) & low;
+	else if (piece == Board::White) found = (code >> 1) & ~code & low;
+	else return 0;
+	uint32_t n = 0;
+	for (; found; found &= found - 1) ++n;
+	return n;
+}
+
+bool Solver::is_win(uint64_t code) {
+	return count(code, Board::Black) == 1 && count(code, Board::White) == 1;
+}
+
+uint64_t Solver::transform(uint64_t code, uint32_t symmetry) const {
+	std::vector< uint8_t > const &perm = permutations[symmetry / 2];
+	uint64_t ret = 0;
+	for (uint32_t i = 0; i < perm.size(); ++i) {
+		ret |= ((code >> (2 * i)) & 3) << (2 * perm[i]);
+	}
+	if (symmetry & 1) { //swap Black (01) and White (10):
+		const uint64_t low = 0x5555555555555555ULL;
+		ret = ((ret & low) << 1) | ((ret >> 1) & low);
+	}
+	return ret;
+}
+
+uint64_t Solver::canonical(uint64_t code) const {
+	uint64_t best = code;
+	for (uint32_t s = 1; s < symmetries(); ++s) {
+		best = std::min(best, transform(code, s));
+	}
+	return best;
+}
+
+bool Solver::visit(uint64_t code) {
+	if ((queue.size() + 1) * 2 > slots.size()) { //keep the table at most half full
+		slots.assign(slots.size() * 2, 0);
+		stamps.assign(slots.size(), 0);
+		stamp = 1;
+		size_t mask = slots.size() - 1;
+		for (uint64_t q : queue) {
+			size_t s = mix(q) & mask;
+			while (stamps[s] == stamp) s = (s + 1) & mask;
+			slots[s] = q;
+			stamps[s] = stamp;
+		}
+	}
+	size_t mask = slots.size() - 1;
+	size_t s = mix(code) & mask;
+	while (stamps[s] == stamp) {
+		if (slots[s] == code) return false;
+		s = (s + 1) & mask;
+	}
+	slots[s] = code;
+	stamps[s] = stamp;
+	return true;
+}
+
+int32_t Solver::solve(uint64_t code, uint32_t max_moves) {
+	if (is_win(code)) return 0;
+
+	//start a fresh visited set by bumping the stamp:
+	if (++stamp == 0) {
+		stamps.assign(slots.size(), 0);
+		stamp = 1;
+	}
+	queue.clear();
+	visit(code);
+	queue.emplace_back(code);
+
+	glm::uvec2 transposed_size(size.y, size.x);
+	size_t begin = 0;
+	for (uint32_t depth = 1; depth <= max_moves; ++depth) {
+		size_t end = queue.size();
+		if (begin == end) break; //every reachable state was visited
+		for (size_t i = begin; i < end; ++i) {
+			uint64_t from = queue[i];
+			uint64_t from_columns = transpose(from, to_columns, size);
+			for (uint32_t m = 0; m < 4; ++m) {
+				//row moves directly, column moves on the transposed board:
+				uint64_t to_h = apply_rows(from, row_table.results[m], size);
+				uint64_t to_v = transpose(apply_rows(from_columns, column_table.results[m], transposed_size), to_rows, transposed_size);
+				for (uint64_t to : { to_h, to_v }) {
+					if (to == from) continue;
+					if (is_win(to)) return int32_t(depth);
+					if (visit(to)) queue.emplace_back(to);
+				}
+			}
+		}
+		begin = end;
+	}
+	return Unsolvable;
+}
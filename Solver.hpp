@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Board.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// The 'Solver' struct rates packed boards (see Board::pack) by the length of
+// their optimal solution, using a breadth-first search over board states.
+// Moves are applied to whole rows/columns through precomputed lookup tables,
+// so a typical 4x4 board is rated in tens of microseconds.
+// A Solver keeps scratch buffers between calls; use one per thread.
+
+struct Solver {
+	//throws if boards of this size can't be packed or have lines longer than MaxLine:
+	Solver(glm::uvec2 size);
+
+	static constexpr uint32_t MaxLine = 8;
+	glm::uvec2 size;
+
+	//solve returns the fewest moves needed to win from 'code',
+	// or Unsolvable if the board cannot be won in at most max_moves moves:
+	static constexpr int32_t Unsolvable = -1;
+	int32_t solve(uint64_t code, uint32_t max_moves = 32);
+
+	//apply a move to a packed board:
+	uint64_t apply(uint64_t code, Board::Move move) const;
+
+	//piece counts and win test on packed boards:
+	static uint32_t count(uint64_t code, Board::Piece piece);
+	static bool is_win(uint64_t code);
+
+	//------- symmetry -------
+	//Mirroring, rotating (square boards only) and swapping colors all leave the
+	// optimal solution length unchanged. Symmetry 0 is the identity:
+	uint32_t symmetries() const { return uint32_t(permutations.size()) * 2; }
+	uint64_t transform(uint64_t code, uint32_t symmetry) const;
+
+	//canonical returns the smallest code among all transforms of 'code':
+	uint64_t canonical(uint64_t code) const;
+
+	//canonical_hash is equal for all boards related by symmetry:
+	uint64_t canonical_hash(uint64_t code) const { return hash(canonical(code)); }
+	static uint64_t hash(uint64_t code);
+
+private:
+	std::vector< std::vector< uint8_t > > permutations; //permutations[s][i] is where cell i lands under spatial symmetry s
+
+	//results of Left, Right, PowerLeft, PowerRight on every packed line of a given length:
+	struct LineTable {
+		std::vector< uint16_t > results[4];
+	};
+	static LineTable make_line_table(uint32_t length);
+	LineTable row_table, column_table;
+
+	//Vertical moves are done as row moves on the transposed board (columns stored as rows).
+	//to_columns[r * 4^size.x + row] holds row 'r' scattered into its transposed positions; to_rows is the reverse:
+	std::vector< uint64_t > to_columns, to_rows;
+	static std::vector< uint64_t > make_transpose_table(glm::uvec2 size);
+	static uint64_t transpose(uint64_t code, std::vector< uint64_t > const &table, glm::uvec2 size);
+	static uint64_t apply_rows(uint64_t code, std::vector< uint16_t > const &table, glm::uvec2 size);
+
+	//breadth-first search scratch:
+	std::vector< uint64_t > queue; //every visited state, in visit order
+	std::vector< uint64_t > slots; //open-addressing hash set of visited states...
+	std::vector< uint32_t > stamps; //...where a slot is in use if its stamp matches 'stamp'
+	uint32_t stamp = 0;
+	bool visit(uint64_t code); //returns true if code was not yet visited
+};
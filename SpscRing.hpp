@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// 'SpscRing' is a fixed-size lock-free queue for exactly one producer thread
+// and one consumer thread. push and pop never block; they return false when
+// the ring is full or empty, respectively.
+
+template< typename T, uint32_t Capacity >
+struct SpscRing {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+	//producer side:
+	bool push(T const &value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		items[t & (Capacity - 1)] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool full() const {
+		return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == Capacity;
+	}
+
+	//consumer side:
+	bool pop(T *value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = items[h & (Capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[Capacity];
+	//indices count up forever (wrapping is fine since Capacity divides 2^32);
+	//they are padded apart so the two threads don't write the same cache line:
+	std::atomic< uint32_t > head{0}; //next item to pop, written by consumer
+	char padding[64];
+	std::atomic< uint32_t > tail{0}; //next slot to fill, written by producer
+};
@@ -0,0 +1,52 @@
+#include "StagePool.hpp"
+
+#include <cassert>
+
+StagePool::StagePool(glm::uvec2 size) : solver(size), buckets(MaxMoves + 1) {
+}
+
+void StagePool::refill(Rng &rng, uint32_t count) {
+	uint32_t cells = solver.size.x * solver.size.y;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint64_t code = rng.ternary_packed(cells); //Empty, Black, White
+		//a stage needs at least one piece of each color and must not already be won:
+		if (Solver::count(code, Board::Black) < 1 || Solver::count(code, Board::White) < 1) continue;
+		int32_t moves = solver.solve(code, MaxMoves);
+		if (moves < 1) continue;
+		std::vector< uint64_t > &bucket = buckets[moves];
+		if (bucket.size() < BucketCapacity) {
+			bucket.emplace_back(code);
+		}
+	}
+}
+
+bool StagePool::take(uint32_t min_moves, uint32_t max_moves, Rng &rng, uint64_t *code, uint32_t *moves) {
+	assert(code && moves);
+	if (min_moves < 1) min_moves = 1;
+	if (max_moves > MaxMoves) max_moves = MaxMoves;
+
+	//pick uniformly among the non-empty buckets in range, so every difficulty is equally likely:
+	uint32_t non_empty[MaxMoves + 1];
+	uint32_t found = 0;
+	for (uint32_t n = min_moves; n <= max_moves; ++n) {
+		if (!buckets[n].empty()) non_empty[found++] = n;
+	}
+	if (found == 0) return false;
+
+	uint32_t n = non_empty[rng.below(found)];
+	*code = buckets[n].back();
+	*moves = n;
+	buckets[n].pop_back();
+	return true;
+}
+
+bool StagePool::take_nearest(uint32_t min_moves, uint32_t max_moves, Rng &rng, uint64_t *code, uint32_t *moves) {
+	if (take(min_moves, max_moves, rng, code, moves)) return true;
+	if (max_moves > MaxMoves) max_moves = MaxMoves;
+	//widen the range one step at a time in both directions:
+	for (uint32_t d = 1; d <= MaxMoves; ++d) {
+		if (min_moves > d && take(min_moves - d, min_moves - d, rng, code, moves)) return true;
+		if (max_moves + d <= MaxMoves && take(max_moves + d, max_moves + d, rng, code, moves)) return true;
+	}
+	return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Solver.hpp"
+#include "Rng.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// The 'StagePool' struct keeps rated stages in buckets by the length of their
+// optimal solution, so a stage in a requested difficulty range can be handed
+// out with a single pop instead of a generate-and-test loop. Each valid stage
+// is kept in the bucket for its solution length, unless that bucket is full
+// (or the stage needs more than MaxMoves moves), in which case it is dropped.
+
+struct StagePool {
+	StagePool(glm::uvec2 size);
+
+	static constexpr uint32_t MaxMoves = 16; //stages that need more moves are discarded
+	static constexpr uint32_t BucketCapacity = 64; //stages kept per bucket
+
+	//generate and rate 'count' random stages, keeping those that land in a bucket with room:
+	void refill(Rng &rng, uint32_t count);
+
+	//take a stage whose optimal solution length is in [min_moves, max_moves];
+	// returns false (and takes nothing) if those buckets are empty:
+	bool take(uint32_t min_moves, uint32_t max_moves, Rng &rng, uint64_t *code, uint32_t *moves);
+
+	//take a stage from the non-empty bucket closest to [min_moves, max_moves];
+	// returns false only if the pool is empty:
+	bool take_nearest(uint32_t min_moves, uint32_t max_moves, Rng &rng, uint64_t *code, uint32_t *moves);
+
+	Solver solver;
+	std::vector< std::vector< uint64_t > > buckets; //buckets[n] holds packed stages solvable in exactly n moves
+};
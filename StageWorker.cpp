@@ -0,0 +1,82 @@
+#include "StageWorker.hpp"
+
+static uint64_t pack_range(uint32_t min_moves, uint32_t max_moves) {
+	return (uint64_t(min_moves) << 32) | max_moves;
+}
+
+StageWorker::StageWorker(glm::uvec2 size, uint32_t min_moves, uint32_t max_moves, uint64_t seed) : range(pack_range(min_moves, max_moves)) {
+	thread = std::thread(&StageWorker::run, this, size, seed);
+}
+
+StageWorker::~StageWorker() {
+	quit = true;
+	signal();
+	thread.join();
+}
+
+void StageWorker::set_range(uint32_t min_moves, uint32_t max_moves) {
+	range = pack_range(min_moves, max_moves);
+}
+
+void StageWorker::signal() {
+	std::lock_guard< std::mutex > lock(mutex);
+	changed.notify_all();
+}
+
+bool StageWorker::pop(Stage *stage) {
+	if (!ready.pop(stage)) return false;
+	signal(); //(the worker may be waiting for room)
+	return true;
+}
+
+bool StageWorker::pop(Stage *stage, std::chrono::milliseconds timeout) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		if (!changed.wait_for(lock, timeout, [&]() { return ready.pop(stage); })) return false;
+	}
+	signal();
+	return true;
+}
+
+void StageWorker::pop_wait(Stage *stage) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		changed.wait(lock, [&]() { return ready.pop(stage); });
+	}
+	signal();
+}
+
+void StageWorker::run(glm::uvec2 size, uint64_t seed) {
+	//the pool (and its solver scratch space) belongs to this thread only:
+	StagePool pool(size);
+	Rng rng(seed);
+	pool.refill(rng, 2048); //fill the difficulty buckets up front
+
+	while (!quit) {
+		if (ready.full()) {
+			//nothing to do until the game takes a stage:
+			std::unique_lock< std::mutex > lock(mutex);
+			changed.wait(lock, [this]() { return quit || !ready.full(); });
+			continue;
+		}
+		uint64_t packed = range;
+		uint32_t min = uint32_t(packed >> 32), max = uint32_t(packed);
+		Stage stage;
+		bool found = pool.take(min, max, rng, &stage.code, &stage.moves);
+		//in case the requested buckets are empty, rate a few more batches before settling for the closest difficulty:
+		for (uint32_t attempt = 0; !found && attempt < 4; ++attempt) {
+			pool.refill(rng, 256);
+			found = pool.take(min, max, rng, &stage.code, &stage.moves);
+		}
+		if (!found) {
+			found = pool.take_nearest(min, max, rng, &stage.code, &stage.moves);
+		}
+		if (found) {
+			stage.hash = pool.solver.canonical_hash(stage.code);
+			ready.push(stage);
+			signal(); //(the game may be waiting for a stage)
+		}
+		//keep the buckets stocked:
+		pool.refill(rng, 64);
+	}
+}
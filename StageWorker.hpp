@@ -0,0 +1,56 @@
+#pragma once
+
+#include "StagePool.hpp"
+#include "SpscRing.hpp"
+
+#include <glm/glm.hpp>
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+// The 'StageWorker' struct generates and rates stages on a background thread,
+// keeping a small ring of ready stages so the game thread can take one in
+// constant time (e.g., on a Win transition or when the player presses R).
+
+struct StageWorker {
+	//starts the worker thread, producing stages in [min_moves, max_moves]; 'seed' seeds its random engine,
+	// so the sequence of stages is reproducible as long as the range doesn't change:
+	StageWorker(glm::uvec2 size, uint32_t min_moves, uint32_t max_moves, uint64_t seed);
+	//stops and joins the worker thread:
+	~StageWorker();
+
+	struct Stage {
+		uint64_t code = 0; //packed board (see Board::pack)
+		uint32_t moves = 0; //optimal solution length
+		uint64_t hash = 0; //canonical hash (see Solver::canonical_hash)
+	};
+
+	//change the range of optimal solution lengths the worker produces;
+	// stages already in the ring may still be from the old range:
+	void set_range(uint32_t min_moves, uint32_t max_moves);
+
+	//take a ready stage; returns false if the ring is empty (game thread only):
+	bool pop(Stage *stage);
+	//same, but waits up to 'timeout' for the worker to produce one (game thread only):
+	bool pop(Stage *stage, std::chrono::milliseconds timeout);
+	//same, but waits as long as it takes:
+	void pop_wait(Stage *stage);
+
+private:
+	void run(glm::uvec2 size, uint64_t seed);
+
+	SpscRing< Stage, 16 > ready;
+	//[min_moves, max_moves] packed as (min << 32) | max, so the worker never sees half of a set_range:
+	std::atomic< uint64_t > range;
+	std::atomic< bool > quit{false};
+	//both threads sleep on 'changed' (the worker while the ring is full, the game while it's empty);
+	//ring changes are signaled while holding 'mutex', so a wakeup can't be missed:
+	std::mutex mutex;
+	std::condition_variable changed;
+	void signal();
+	std::thread thread;
+};
@@ -0,0 +1,99 @@
+#include "StreamBuffer.hpp"
+
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+
+StreamBuffer::StreamBuffer(GLsizeiptr size_) : size(size_) {
+	if (size <= 0 || size % Alignment != 0) {
+		throw std::runtime_error("StreamBuffer size must be a positive multiple of Alignment.");
+	}
+	glGenBuffers(1, &buffer);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+}
+
+StreamBuffer::~StreamBuffer() {
+	for (Fence const &f : fences) {
+		glDeleteSync(f.sync);
+	}
+	fences.clear();
+	glDeleteBuffers(1, &buffer);
+	buffer = -1U;
+}
+
+GLintptr StreamBuffer::write(void const *data, GLsizeiptr bytes) {
+	if (bytes <= 0) return 0;
+	uint64_t padded = (uint64_t(bytes) + Alignment - 1) / Alignment * Alignment;
+
+	//writes don't wrap around the end of the buffer:
+	uint64_t begin = head;
+	if (begin % size + padded > uint64_t(size)) begin += size - begin % size;
+
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+	//wait for the GPU to finish with the space, oldest frame first:
+	while (begin + padded - tail > uint64_t(size)) {
+		if (fences.empty()) {
+			//everything but the data still in use is free, and it still doesn't fit; make a bigger buffer
+			//(glBufferData leaves the old storage to any draws that still read it):
+			GLsizeiptr new_size = 2 * size;
+			while (uint64_t(new_size) < 2 * padded) new_size *= 2;
+			std::cerr << "NOTE: stream buffer grown from " << size << " to " << new_size << " bytes." << std::endl;
+			size = new_size;
+			glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			head = tail = begin = 0;
+			++grows;
+			break;
+		}
+		retire(true);
+	}
+
+	GLintptr offset = GLintptr(begin % size);
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!mapped) throw std::runtime_error("Failed to map stream buffer.");
+	std::memcpy(mapped, data, bytes);
+	if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+		//the contents were lost while mapped (rare; e.g. on a display mode change), so just copy them again:
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+	}
+
+	latest = begin;
+	head = begin + padded;
+	written = true;
+	return offset;
+}
+
+void StreamBuffer::end_frame() {
+	retire(false);
+	//frames without writes don't need a fence, since the last one already frees everything before 'latest':
+	if (!written) return;
+	written = false;
+	Fence fence;
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence.free_to = latest;
+	fences.emplace_back(fence);
+}
+
+//frees the space behind signaled fences; with 'wait', blocks until (at least) the oldest fence is signaled:
+void StreamBuffer::retire(bool wait) {
+	while (!fences.empty()) {
+		Fence const &f = fences.front();
+		GLenum result = glClientWaitSync(f.sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ULL : 0);
+		if (result == GL_WAIT_FAILED) throw std::runtime_error("Failed to wait on stream buffer fence.");
+		if (result == GL_TIMEOUT_EXPIRED) {
+			if (!wait) return;
+			continue; //(the GPU is taking more than a second; keep waiting)
+		}
+		tail = std::max(tail, f.free_to);
+		glDeleteSync(f.sync);
+		fences.pop_front();
+		if (wait) {
+			++waits;
+			return;
+		}
+	}
+}
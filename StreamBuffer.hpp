@@ -0,0 +1,58 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <cstdint>
+#include <deque>
+
+// 'StreamBuffer' hands out space in one large GL_ARRAY_BUFFER for data that is
+// rewritten often (e.g. instance offsets). write() copies into the next free
+// part of the ring through an unsynchronized mapping, so the driver never has
+// to stall or copy a buffer the GPU may still be reading; fences placed by
+// end_frame() tell it which parts the GPU is done with.
+//
+// The data from the most recent write() stays valid (for any number of frames)
+// until the next write(); earlier writes are only valid for the frame they were
+// made in:
+//   GLintptr offset = stream.write(data, bytes); //...point attributes at stream.buffer + offset, draw...
+//   stream.end_frame();
+
+struct StreamBuffer {
+	StreamBuffer(GLsizeiptr size);
+	~StreamBuffer();
+	StreamBuffer(StreamBuffer const &) = delete;
+	StreamBuffer &operator=(StreamBuffer const &) = delete;
+
+	//copies 'bytes' bytes from 'data' into the ring and returns their offset in 'buffer'
+	//(leaves 'buffer' bound to GL_ARRAY_BUFFER through gl_state):
+	GLintptr write(void const *data, GLsizeiptr bytes);
+
+	//call after issuing the frame's draws:
+	void end_frame();
+
+	GLuint buffer = -1U; //(the name never changes, even if the ring has to grow)
+	GLsizeiptr size = 0;
+
+	//times write() had to wait for the GPU, or grow the ring because a write didn't fit:
+	uint64_t waits = 0;
+	uint64_t grows = 0;
+
+	//writes start at multiples of this, so attribute offsets stay aligned:
+	static constexpr GLsizeiptr Alignment = 16;
+
+private:
+	//positions count bytes ever handed out, so they never wrap; the offset in 'buffer' is position % size.
+	uint64_t head = 0; //next free byte
+	uint64_t tail = 0; //everything before this is free
+	uint64_t latest = 0; //start of the most recent write
+	bool written = false; //any write() since the last end_frame()
+
+	//once 'sync' is signaled, everything before 'free_to' can be reused:
+	struct Fence {
+		GLsync sync;
+		uint64_t free_to;
+	};
+	std::deque< Fence > fences;
+
+	void retire(bool wait);
+};
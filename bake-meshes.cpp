@@ -0,0 +1,284 @@
+//bake-meshes turns the triangle soup written by meshes/export-meshes.py into indexed meshes.
+//Usage:
+//  bake-meshes <in.blob> <out.blob> [--grid G] [--compact]
+//For each mesh, vertices whose position, normal and color match are merged (positions and normals
+// are compared after rounding to multiples of 1/G, default 4096, since the exporter's normals are
+// slightly noisy), triangles are reordered to reuse vertices still in the GPU's post-transform cache
+// (Tom Forsyth's "linear-speed vertex cache optimisation"), and vertices are reordered by first use.
+//
+//The output has the input's "dat0", "str0" and "idx0" chunks (with deduplicated vertex ranges), followed by:
+//  "ind0" : uint32 vertex indices, relative to the first vertex of their mesh
+//  "inr0" : one IndexRange per "idx0" entry
+//With --compact, "dat0" is replaced by "dat1", holding 16-byte CompactVertex records instead.
+//<in.blob> and <out.blob> may be the same file.
+
+#include "CompactVertex.hpp"
+#include "read_chunk.hpp"
+#include "write_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+};
+static_assert(sizeof(Vertex) == 28, "Vertex should be packed.");
+
+struct IndexEntry {
+	uint32_t name_begin;
+	uint32_t name_end;
+	uint32_t vertex_begin;
+	uint32_t vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "IndexEntry should be packed.");
+
+struct IndexRange {
+	uint32_t index_begin;
+	uint32_t index_end;
+};
+static_assert(sizeof(IndexRange) == 8, "IndexRange should be packed.");
+
+//reorder triangles (index triples into 'vertex_count' vertices) to make good use of a post-transform cache,
+// following https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html :
+static std::vector< uint32_t > optimize_triangle_order(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+	const int32_t CacheSize = 32;
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	struct VertexData {
+		int32_t cache_position = -1;
+		float score = 0.0f;
+		std::vector< uint32_t > triangles; //not yet emitted
+	};
+	std::vector< VertexData > vertices(vertex_count);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			vertices[indices[3*t+i]].triangles.emplace_back(t);
+		}
+	}
+
+	auto vertex_score = [&](VertexData const &v) {
+		if (v.triangles.empty()) return -1.0f; //nothing left to draw with it
+		float score = 0.0f;
+		if (v.cache_position >= 0) {
+			if (v.cache_position < 3) {
+				score = 0.75f; //used by the last triangle; fixed score so strips don't get favored too much
+			} else {
+				score = std::pow(1.0f - float(v.cache_position - 3) / float(CacheSize - 3), 1.5f);
+			}
+		}
+		//boost vertices with few triangles left, so they get finished off:
+		score += 2.0f * std::pow(float(v.triangles.size()), -0.5f);
+		return score;
+	};
+
+	std::vector< float > triangle_scores(triangle_count, 0.0f);
+	std::vector< bool > emitted(triangle_count, false);
+	for (auto &v : vertices) {
+		v.score = vertex_score(v);
+	}
+	auto triangle_score = [&](uint32_t t) {
+		return vertices[indices[3*t+0]].score + vertices[indices[3*t+1]].score + vertices[indices[3*t+2]].score;
+	};
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		triangle_scores[t] = triangle_score(t);
+	}
+
+	std::vector< uint32_t > order;
+	order.reserve(indices.size());
+	std::vector< uint32_t > cache;
+	int64_t best = -1;
+	for (uint32_t emit = 0; emit < triangle_count; ++emit) {
+		if (best < 0) { //no candidate in the cache; scan everything
+			float best_score = -1.0f;
+			for (uint32_t t = 0; t < triangle_count; ++t) {
+				if (!emitted[t] && triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+		}
+		uint32_t t = uint32_t(best);
+		emitted[t] = true;
+
+		//emit the triangle and move its vertices to the front of the cache:
+		std::vector< uint32_t > new_cache;
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t v = indices[3*t+i];
+			order.emplace_back(v);
+			auto &tris = vertices[v].triangles;
+			tris.erase(std::find(tris.begin(), tris.end(), t));
+			new_cache.emplace_back(v);
+		}
+		for (uint32_t v : cache) {
+			if (std::find(new_cache.begin(), new_cache.begin() + 3, v) == new_cache.begin() + 3) new_cache.emplace_back(v);
+		}
+
+		//update the scores of everything that was or is in the cache:
+		for (uint32_t i = 0; i < new_cache.size(); ++i) {
+			VertexData &v = vertices[new_cache[i]];
+			v.cache_position = (int32_t(i) < CacheSize ? int32_t(i) : -1);
+			v.score = vertex_score(v);
+		}
+		if (int32_t(new_cache.size()) > CacheSize) new_cache.resize(CacheSize);
+		cache = new_cache;
+
+		//the next triangle is the best one using a cached vertex (if any):
+		best = -1;
+		float best_score = -1.0f;
+		for (uint32_t v : cache) {
+			for (uint32_t u : vertices[v].triangles) {
+				triangle_scores[u] = triangle_score(u);
+				if (triangle_scores[u] > best_score) {
+					best_score = triangle_scores[u];
+					best = u;
+				}
+			}
+		}
+	}
+	return order;
+}
+
+//average number of vertex shader runs per triangle with a FIFO post-transform cache of the given size:
+static float acmr(std::vector< uint32_t > const &indices, uint32_t cache_size) {
+	std::vector< uint32_t > fifo;
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		if (std::find(fifo.begin(), fifo.end(), i) != fifo.end()) continue;
+		++misses;
+		fifo.insert(fifo.begin(), i);
+		if (fifo.size() > cache_size) fifo.pop_back();
+	}
+	return indices.empty() ? 0.0f : float(misses) / float(indices.size() / 3);
+}
+
+int main(int argc, char **argv) {
+	std::string infile, outfile;
+	float grid = 4096.0f;
+	bool compact = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--grid" && i + 1 < argc) {
+			grid = float(std::atof(argv[++i]));
+		} else if (arg == "--compact") {
+			compact = true;
+		} else if (infile.empty() && arg[0] != '-') {
+			infile = arg;
+		} else if (outfile.empty() && arg[0] != '-') {
+			outfile = arg;
+		} else {
+			outfile = "";
+			break;
+		}
+	}
+	if (outfile.empty() || !(grid > 0.0f)) {
+		std::cerr << "Usage:\n\tbake-meshes <in.blob> <out.blob> [--grid G] [--compact]" << std::endl;
+		return 1;
+	}
+
+	std::vector< Vertex > vertices;
+	std::vector< char > names;
+	std::vector< IndexEntry > entries;
+	{
+		std::ifstream blob(infile, std::ios::binary);
+		if (peek_chunk(blob, "dat1")) {
+			std::cerr << "'" << infile << "' is already baked." << std::endl;
+			return 1;
+		}
+		read_chunk(blob, "dat0", &vertices);
+		read_chunk(blob, "str0", &names);
+		read_chunk(blob, "idx0", &entries);
+		if (peek_chunk(blob, "ind0")) {
+			std::cerr << "'" << infile << "' is already indexed." << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector< Vertex > out_vertices;
+	std::vector< uint32_t > out_indices;
+	std::vector< IndexEntry > out_entries;
+	std::vector< IndexRange > out_ranges;
+	for (IndexEntry const &e : entries) {
+		if (e.name_begin > e.name_end || e.name_end > names.size()) {
+			throw std::runtime_error("invalid name indices in index.");
+		}
+		if (e.vertex_begin > e.vertex_end || e.vertex_end > vertices.size() || (e.vertex_end - e.vertex_begin) % 3 != 0) {
+			throw std::runtime_error("invalid vertex indices in index.");
+		}
+		std::string name(names.begin() + e.name_begin, names.begin() + e.name_end);
+
+		//merge matching vertices:
+		typedef std::tuple< int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, uint32_t > Key;
+		auto key = [&](Vertex const &v) {
+			auto q = [&](float f) { return int64_t(std::floor(f * grid + 0.5f)); };
+			uint32_t color = uint32_t(v.Color.x) | (uint32_t(v.Color.y) << 8) | (uint32_t(v.Color.z) << 16) | (uint32_t(v.Color.w) << 24);
+			return Key(q(v.Position.x), q(v.Position.y), q(v.Position.z), q(v.Normal.x), q(v.Normal.y), q(v.Normal.z), color);
+		};
+		std::map< Key, uint32_t > unique;
+		std::vector< Vertex > mesh_vertices;
+		std::vector< uint32_t > mesh_indices;
+		for (uint32_t i = e.vertex_begin; i < e.vertex_end; ++i) {
+			auto ret = unique.insert(std::make_pair(key(vertices[i]), uint32_t(mesh_vertices.size())));
+			if (ret.second) mesh_vertices.emplace_back(vertices[i]);
+			mesh_indices.emplace_back(ret.first->second);
+		}
+
+		//reorder triangles for the vertex cache, then vertices by first use (for the pre-transform cache):
+		float acmr_before = acmr(mesh_indices, 16);
+		mesh_indices = optimize_triangle_order(mesh_indices, uint32_t(mesh_vertices.size()));
+		std::vector< uint32_t > remap(mesh_vertices.size(), -1U);
+		IndexEntry out_entry = e;
+		out_entry.vertex_begin = uint32_t(out_vertices.size());
+		IndexRange range;
+		range.index_begin = uint32_t(out_indices.size());
+		for (uint32_t &i : mesh_indices) {
+			if (remap[i] == -1U) {
+				remap[i] = uint32_t(out_vertices.size()) - out_entry.vertex_begin;
+				out_vertices.emplace_back(mesh_vertices[i]);
+			}
+			i = remap[i];
+			out_indices.emplace_back(i);
+		}
+		out_entry.vertex_end = uint32_t(out_vertices.size());
+		range.index_end = uint32_t(out_indices.size());
+		out_entries.emplace_back(out_entry);
+		out_ranges.emplace_back(range);
+
+		std::cout << "  '" << name << "': " << (e.vertex_end - e.vertex_begin) << " -> " << (out_entry.vertex_end - out_entry.vertex_begin) << " vertices, "
+			<< "vertex shader runs per triangle (16-entry FIFO) " << acmr_before << " -> " << acmr(mesh_indices, 16) << std::endl;
+	}
+
+	std::ofstream blob(outfile, std::ios::binary);
+	if (compact) {
+		std::vector< CompactVertex > compact_vertices;
+		compact_vertices.reserve(out_vertices.size());
+		float position_error = 0.0f, normal_error = 0.0f;
+		for (Vertex const &v : out_vertices) {
+			compact_vertices.emplace_back(v.Position, v.Normal, v.Color);
+			position_error = std::max(position_error, glm::length(compact_vertices.back().position() - v.Position));
+			normal_error = std::max(normal_error, glm::length(compact_vertices.back().normal() - v.Normal));
+		}
+		std::cout << "  compact vertices: largest position error " << position_error << ", normal error " << normal_error << std::endl;
+		write_chunk(blob, "dat1", compact_vertices);
+	} else {
+		write_chunk(blob, "dat0", out_vertices);
+	}
+	write_chunk(blob, "str0", names);
+	write_chunk(blob, "idx0", out_entries);
+	write_chunk(blob, "ind0", out_indices);
+	write_chunk(blob, "inr0", out_ranges);
+	std::cout << "Wrote " << blob.tellp() << " bytes (" << out_vertices.size() << " vertices, " << out_indices.size() << " indices) to '" << outfile << "'." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+//build-corpus writes a stage corpus (see Corpus.hpp) for the game to sample from.
+//Usage:
+//  build-corpus <out.corpus> [--size WxH] [--count N] [--max-moves M] [--seed S]
+//Sizes with at most 3^16 layouts (e.g., the default 4x4) are enumerated exhaustively unless
+// --count is given; larger sizes are sampled at random. Each symmetry class (see Solver::canonical)
+// is stored once, as its canonical board; the game applies a random symmetry when it samples.
+
+#include "Solver.hpp"
+#include "Corpus.hpp"
+#include "write_chunk.hpp"
+#include "Rng.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_set>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+int main(int argc, char **argv) {
+	std::string outfile;
+	glm::uvec2 size(4,4);
+	uint64_t count = 0; //0 means enumerate everything
+	uint32_t max_moves = 16;
+	uint64_t seed = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc) {
+			if (std::sscanf(argv[++i], "%ux%u", &size.x, &size.y) != 2) {
+				std::cerr << "Expected --size WxH." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--max-moves" && i + 1 < argc) {
+			max_moves = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+			if (max_moves > Corpus::MaxMoves) {
+				std::cerr << "Expected --max-moves M with M <= " << Corpus::MaxMoves << "." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--seed" && i + 1 < argc) {
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		} else if (outfile.empty() && arg[0] != '-') {
+			outfile = arg;
+		} else {
+			outfile = "";
+			break;
+		}
+	}
+	if (outfile.empty()) {
+		std::cerr << "Usage:\n\tbuild-corpus <out.corpus> [--size WxH] [--count N] [--max-moves M] [--seed S]" << std::endl;
+		return 1;
+	}
+
+	Solver solver(size);
+	uint32_t cells = size.x * size.y;
+	std::vector< std::vector< uint64_t > > buckets(max_moves + 1);
+
+	//rate a canonical board and file it by optimal solution length:
+	uint64_t kept = 0;
+	auto add = [&](uint64_t code) {
+		if (Solver::count(code, Board::Black) < 1 || Solver::count(code, Board::White) < 1) return false;
+		int32_t moves = solver.solve(code, max_moves);
+		if (moves < 1) return false; //already won or not solvable in max_moves
+		buckets[moves].emplace_back(code);
+		++kept;
+		return true;
+	};
+
+	if (count == 0 && cells <= 16) {
+		std::cout << "Enumerating all " << size.x << "x" << size.y << " boards..." << std::endl;
+		uint64_t layouts = 1;
+		for (uint32_t c = 0; c < cells; ++c) layouts *= 3;
+		uint64_t code = 0;
+		for (uint64_t i = 0; i < layouts; ++i) {
+			if (solver.canonical(code) == code) add(code);
+			if ((i & 0xfffff) == 0) {
+				std::cout << "\r  " << (100 * i / layouts) << "% (" << kept << " kept)" << std::flush;
+			}
+			//count up in base 3, two bits per digit:
+			for (uint32_t c = 0; c < cells; ++c) {
+				uint64_t digit = (code >> (2 * c)) & 3;
+				code &= ~(uint64_t(3) << (2 * c));
+				if (digit < 2) {
+					code |= (digit + 1) << (2 * c);
+					break;
+				}
+			}
+		}
+	} else {
+		if (count == 0) count = 1000000;
+		std::cout << "Sampling " << count << " random " << size.x << "x" << size.y << " boards..." << std::endl;
+		Rng rng(seed);
+		std::unordered_set< uint64_t > seen;
+		//give up if random boards stop turning up new symmetry classes:
+		for (uint64_t tries = 0; kept < count && tries < count * 64; ++tries) {
+			uint64_t code = solver.canonical(rng.ternary_packed(cells));
+			if (!seen.insert(code).second) continue;
+			add(code);
+			if ((tries & 0xffff) == 0) {
+				std::cout << "\r  " << (100 * kept / count) << "% (" << kept << " kept)" << std::flush;
+			}
+		}
+	}
+	std::cout << "\r  done (" << kept << " kept)." << std::endl;
+
+	//flatten buckets into the corpus chunks:
+	Corpus::Info info;
+	info.width = size.x;
+	info.height = size.y;
+	info.max_moves = max_moves;
+
+	std::vector< uint64_t > offsets;
+	std::vector< uint64_t > boards;
+	std::vector< uint64_t > hashes;
+	boards.reserve(kept);
+	hashes.reserve(kept);
+	for (uint32_t n = 0; n <= max_moves; ++n) {
+		offsets.emplace_back(boards.size());
+		for (uint64_t code : buckets[n]) {
+			boards.emplace_back(code);
+			hashes.emplace_back(Solver::hash(code));
+		}
+		std::cout << "  " << n << " moves: " << buckets[n].size() << " stages" << std::endl;
+	}
+	offsets.emplace_back(boards.size());
+
+	std::ofstream out(outfile, std::ios::binary);
+	write_chunk(out, "crp0", std::vector< Corpus::Info >(1, info));
+	write_chunk(out, "off0", offsets);
+	write_chunk(out, "brd0", boards);
+	write_chunk(out, "hsh0", hashes);
+	std::cout << "Wrote " << out.tellp() << " bytes to '" << outfile << "'." << std::endl;
+
+	return 0;
+}
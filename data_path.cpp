@@ -3,6 +3,7 @@
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <stdexcept>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -12,9 +13,12 @@
 #include <io.h>
 #elif defined(__APPLE__)
 #include <mach-o/dyld.h>
+#include <sys/stat.h>
+#include <cstdlib>
 #elif defined(__linux__)
 #include <unistd.h>
 #include <sys/stat.h>
+#include <cstdlib>
 #endif //WINDOWS
 
 //get_data_path() gets the directory containing the executable
@@ -71,3 +75,52 @@ std::string data_path(std::string const &suffix) {
 	static std::string path = get_data_path();
 	return path + "/" + suffix;
 }
+
+//get_user_path() gets (and creates, if needed) a per-user directory for saved data:
+
+static std::string get_user_path() {
+	#if defined(_WIN32)
+	PWSTR folder = NULL;
+	if (SHGetKnownFolderPath(FOLDERID_RoamingAppData, 0, NULL, &folder) != S_OK) {
+		CoTaskMemFree(folder);
+		throw std::runtime_error("Failed to find the AppData folder.");
+	}
+	std::wstring wide = folder;
+	CoTaskMemFree(folder);
+	std::string ret(wide.begin(), wide.end()); //NOTE: assumes the path is plain ASCII
+	ret += "\\SlidingBall";
+	_mkdir(ret.c_str());
+	return ret;
+
+	#elif defined(__linux__)
+	//Follow the XDG base directory spec:
+	std::string ret;
+	if (char const *xdg = std::getenv("XDG_DATA_HOME")) {
+		ret = xdg;
+	} else if (char const *home = std::getenv("HOME")) {
+		ret = std::string(home) + "/.local/share";
+		mkdir((std::string(home) + "/.local").c_str(), 0755);
+		mkdir(ret.c_str(), 0755);
+	} else {
+		return get_data_path();
+	}
+	ret += "/sliding-ball";
+	mkdir(ret.c_str(), 0755);
+	return ret;
+
+	#elif defined(__APPLE__)
+	char const *home = std::getenv("HOME");
+	if (!home) return get_data_path();
+	std::string ret = std::string(home) + "/Library/Application Support/SlidingBall";
+	mkdir(ret.c_str(), 0755);
+	return ret;
+
+	#else
+	#error "No idea what the OS is."
+	#endif
+}
+
+std::string user_path(std::string const &suffix) {
+	static std::string path = get_user_path();
+	return path + "/" + suffix;
+}
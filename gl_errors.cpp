@@ -0,0 +1,85 @@
+#include "gl_errors.hpp"
+
+#include <SDL.h>
+
+#include <cstring>
+
+static bool active = false;
+
+bool gl_debug_output_active() {
+	return active;
+}
+
+static char const *source_name(GLenum source) {
+	switch (source) {
+		case GL_DEBUG_SOURCE_API: return "api";
+		case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+		case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+		case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+		case GL_DEBUG_SOURCE_APPLICATION: return "application";
+		default: return "other";
+	}
+}
+
+static char const *type_name(GLenum type) {
+	switch (type) {
+		case GL_DEBUG_TYPE_ERROR: return "error";
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+		case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+		case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+		case GL_DEBUG_TYPE_MARKER: return "marker";
+		default: return "other";
+	}
+}
+
+static char const *severity_name(GLenum severity) {
+	switch (severity) {
+		case GL_DEBUG_SEVERITY_HIGH: return "high";
+		case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+		case GL_DEBUG_SEVERITY_LOW: return "low";
+		default: return "notification";
+	}
+}
+
+static void APIENTRY debug_message(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *) {
+	std::string text(message, length >= 0 ? size_t(length) : std::strlen(message));
+	//(one write per message, since messages may come from several threads at once)
+	std::cerr << std::string(type == GL_DEBUG_TYPE_ERROR ? "WARNING: gl error" : "NOTE: gl message")
+		+ " (" + source_name(source) + ", " + type_name(type) + ", " + severity_name(severity) + ", id " + std::to_string(id) + "): " + text + "\n" << std::flush;
+}
+
+bool gl_debug_output(GLenum min_severity, bool synchronous) {
+	GLint major = 0, minor = 0, flags = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) return false;
+	if (!(major > 4 || (major == 4 && minor >= 3)) && !SDL_GL_ExtensionSupported("GL_KHR_debug")) return false;
+
+	//(GL.hpp only declares GL 3.3, so these are looked up at runtime)
+	auto DebugMessageCallback = reinterpret_cast< PFNGLDEBUGMESSAGECALLBACKPROC >(SDL_GL_GetProcAddress("glDebugMessageCallback"));
+	auto DebugMessageControl = reinterpret_cast< PFNGLDEBUGMESSAGECONTROLPROC >(SDL_GL_GetProcAddress("glDebugMessageControl"));
+	if (!DebugMessageCallback || !DebugMessageControl) return false;
+
+	//filter in the driver, so dropped messages cost nothing: first everything off, then back on from 'min_severity' up:
+	DebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	for (GLenum severity : { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION }) {
+		DebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr, GL_TRUE);
+		if (severity == min_severity) break;
+	}
+	//group push/pop markers are only useful to capture tools:
+	DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+	DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+
+	DebugMessageCallback(debug_message, nullptr);
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous) glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	else glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+	//clear any errors from before, which the callback won't report:
+	while (glGetError() != GL_NO_ERROR) { }
+
+	active = true;
+	return true;
+}
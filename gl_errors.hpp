@@ -7,7 +7,18 @@
 #define STR2(X) # X
 #define STR(X) STR2(X)
 
+//gl_debug_output asks the driver to report errors (and other messages of at least 'min_severity')
+// through a glDebugMessageCallback as they happen, rather than waiting for GL_ERRORS() to poll for them.
+//Needs a debug context with GL 4.3 or GL_KHR_debug; returns false (and changes nothing) otherwise.
+//Messages arrive asynchronously (possibly from a driver thread) unless 'synchronous' is set, which is slower
+// but reports each message from inside the call that caused it (handy with a breakpoint in the callback).
+bool gl_debug_output(GLenum min_severity = GL_DEBUG_SEVERITY_LOW, bool synchronous = false);
+
+//true once gl_debug_output has succeeded (GL_ERRORS() has nothing left to do then):
+bool gl_debug_output_active();
+
 inline void gl_errors(std::string const &where) {
+	if (gl_debug_output_active()) return;
 	GLenum err = 0;
 	while ((err = glGetError()) != GL_NO_ERROR) {
 		#define CHECK( ERR ) \
@@ -28,5 +39,10 @@ inline void gl_errors(std::string const &where) {
 		#undef CHECK
 	}
 }
-#define GL_ERRORS() gl_errors(__FILE__  ":" STR(__LINE__) )
 
+//release builds (NDEBUG; see the Jamfile) don't check for errors at all, since glGetError can stall the pipeline:
+#ifdef NDEBUG
+#define GL_ERRORS() do { } while (0)
+#else
+#define GL_ERRORS() gl_errors(__FILE__  ":" STR(__LINE__) )
+#endif
@@ -3,6 +3,12 @@
 
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
+//...and GLState.hpp skips calls that wouldn't change OpenGL state:
+#include "GLState.hpp"
+//...and gl_errors.hpp reports OpenGL errors (in debug builds):
+#include "gl_errors.hpp"
+//...and GPUTimer.hpp measures GPU time per render pass:
+#include "GPUTimer.hpp"
 
 //Includes for libSDL:
 #include <SDL.h>
@@ -19,20 +25,232 @@
 #include <fstream>
 #include <memory>
 #include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+//clears the current framebuffer, sets some default state, and draws the game into it:
+static void draw_frame(Game &game, glm::uvec2 drawable_size) {
+	gpu_timer.begin(GPUTimer::Clear);
+	glClearColor(0.5, 0.5, 0.5, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gpu_timer.end();
+	gl_state.enable(GL_DEPTH_TEST, true);
+	gl_state.enable(GL_BLEND, true);
+	gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	game.draw(drawable_size);
+	gpu_timer.end_frame();
+}
+
+//--benchmark: draws 'frames' frames of a scripted game into an offscreen framebuffer as fast as
+// possible, waiting for each to finish, and prints frame time statistics.
+//Returns false if the framebuffer couldn't be made or OpenGL reported an error.
+static bool run_benchmark(Game &game, glm::uvec2 size, uint32_t frames) {
+	//render target (the window is hidden and never swapped, so its size and vsync don't matter):
+	GLuint color = 0, depth = 0, framebuffer = 0;
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	gl_state.viewport(0, 0, size.x, size.y);
+
+	bool ok = (status == GL_FRAMEBUFFER_COMPLETE);
+	if (!ok) {
+		std::cerr << "Error: benchmark framebuffer is incomplete (status 0x" << std::hex << status << std::dec << ")." << std::endl;
+	}
+
+	//the script gives each frame one input, in a cycle of six:
+	//  a slide (cycling through all eight moves; slides are instant, so this rebuilds the piece offsets),
+	//  a mouse wheel notch (zooming in for 120 frames, then out, which changes the pieces' level of detail and the tile chunks in view),
+	//  three drag steps (panning around a circle, which changes the cells and chunks in view),
+	//  and nothing (so an unchanged frame, which just replays the draw list, is measured too);
+	//plus a new stage on a win, and every 600 frames in case play gets stuck:
+	static SDL_Scancode const Keys[4] = { SDL_SCANCODE_LEFT, SDL_SCANCODE_UP, SDL_SCANCODE_RIGHT, SDL_SCANCODE_DOWN };
+	uint32_t const ScriptCycle = 6;
+	float const Elapsed = 1.0f / 60.0f; //(update() doesn't use the elapsed time; a fixed step keeps runs comparable if it ever does)
+
+	auto send = [&game, size](SDL_Event const &evt) {
+		game.handle_event(evt, size);
+	};
+	SDL_Event evt;
+	std::memset(&evt, 0, sizeof(evt));
+	glm::ivec2 cursor = glm::ivec2(size / 2u);
+	evt.type = SDL_MOUSEMOTION;
+	evt.motion.x = cursor.x;
+	evt.motion.y = cursor.y;
+	send(evt);
+	std::memset(&evt, 0, sizeof(evt));
+	evt.type = SDL_MOUSEBUTTONDOWN; //(held for the whole run, so every motion drags)
+	evt.button.button = SDL_BUTTON_LEFT;
+	send(evt);
+
+	std::vector< double > cpu_ms, frame_ms; //per frame: update + draw calls; same + waiting for the GPU
+	cpu_ms.reserve(frames);
+	frame_ms.reserve(frames);
+	for (uint32_t f = 0; ok && f < frames; ++f) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (game.game_state == Game::Win || (f > 0 && f % 600 == 0)) {
+			game.generate_new_stage();
+		}
+		uint32_t step = f % ScriptCycle;
+		std::memset(&evt, 0, sizeof(evt));
+		if (step == 0) {
+			uint32_t move = f / ScriptCycle;
+			evt.type = SDL_KEYDOWN;
+			evt.key.keysym.scancode = Keys[move % 4];
+			evt.key.keysym.mod = ((move / 4) % 2 ? KMOD_LSHIFT : KMOD_NONE);
+			send(evt);
+		} else if (step == 1) {
+			evt.type = SDL_MOUSEWHEEL;
+			evt.wheel.y = ((f / 120) % 2 == 0 ? 1 : -1);
+			send(evt);
+		} else if (step < 5) {
+			//the cursor goes around a circle a quarter of the window's height across, once every 180 frames:
+			float angle = float(f) * (2.0f * 3.14159265f / 180.0f);
+			float radius = 0.125f * float(size.y);
+			glm::ivec2 next = glm::ivec2(size / 2u) + glm::ivec2(int(std::lround(radius * std::cos(angle))), int(std::lround(radius * std::sin(angle))));
+			evt.type = SDL_MOUSEMOTION;
+			evt.motion.x = next.x;
+			evt.motion.y = next.y;
+			evt.motion.xrel = next.x - cursor.x;
+			evt.motion.yrel = next.y - cursor.y;
+			cursor = next;
+			send(evt);
+		}
+		game.update(Elapsed);
+		draw_frame(game, size);
+		auto submitted = std::chrono::high_resolution_clock::now();
+
+		//there's no swap to throttle on, so wait for the GPU here (otherwise the driver queues frames and only the CPU gets timed):
+		glFinish();
+		auto finished = std::chrono::high_resolution_clock::now();
+
+		cpu_ms.emplace_back(std::chrono::duration< double, std::milli >(submitted - start).count());
+		frame_ms.emplace_back(std::chrono::duration< double, std::milli >(finished - start).count());
+	}
+
+	if (ok && !frame_ms.empty()) {
+		//checksum of the last frame, to spot rendering changes between runs with the same seed and driver:
+		std::vector< uint8_t > pixels(size.x * size.y * 4);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		uint64_t checksum = 0xcbf29ce484222325ULL; //(64-bit FNV-1a)
+		for (uint8_t p : pixels) checksum = (checksum ^ p) * 0x100000001b3ULL;
+
+		auto summary = [](char const *name, std::vector< double > ms) -> double {
+			std::sort(ms.begin(), ms.end());
+			double total = 0.0;
+			for (double m : ms) total += m;
+			auto at = [&ms](double fraction) {
+				return ms[std::min(ms.size() - 1, size_t(fraction * ms.size()))];
+			};
+			std::cout << "  " << name << " ms: min " << ms.front() << ", mean " << total / ms.size()
+				<< ", median " << at(0.5) << ", p95 " << at(0.95) << ", p99 " << at(0.99) << ", max " << ms.back() << std::endl;
+			return total;
+		};
+		std::cout << "Benchmark: " << frame_ms.size() << " frames at " << size.x << "x" << size.y;
+		GLubyte const *renderer = glGetString(GL_RENDERER);
+		if (renderer) std::cout << " on " << reinterpret_cast< char const * >(renderer);
+		std::cout << std::endl;
+		summary("cpu", cpu_ms);
+		double total = summary("frame", frame_ms);
+		std::cout << "  " << frame_ms.size() / (total * 1e-3) << " frames/s; last frame checksum " << std::hex << checksum << std::dec << std::endl;
+	}
+
+	//GL_ERRORS() doesn't check anything in release builds, so check here (a benchmark run is also a smoke test):
+	for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+		std::cerr << "Error: OpenGL error 0x" << std::hex << error << std::dec << " during benchmark." << std::endl;
+		ok = false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteRenderbuffers(1, &color);
+	return ok;
+}
 
 int main(int argc, char **argv) {
 	struct {
 		//TODO: this is where you set the title and size of your game window
 		std::string title = "Sliding Ball";
 		glm::uvec2 size = glm::uvec2(640, 400);
+		//board size, render mode, lighting, and seed for stage generation:
+		Game::Settings game;
+		//only update and draw when input arrives, the window changes, or the game is animating:
+		bool on_demand = false;
+		//print how many state changes gl_state issued and skipped, on exit:
+		bool gl_stats = false;
+		//draw this many frames offscreen, print timings, and exit (0 means play normally):
+		uint32_t benchmark = 0;
+		bool seed_given = false;
 	} config;
+	config.game.seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+	//------------  command line ------------
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool ok = true;
+		if (arg == "--seed" && i + 1 < argc) { //pass the printed seed to replay a run
+			config.game.seed = std::strtoull(argv[++i], nullptr, 10);
+			config.seed_given = true;
+		} else if (arg == "--board" && i + 1 < argc) {
+			//a stage needs at least three pieces (two of one color and one of the other, or it's already won):
+			glm::uvec2 &board = config.game.board_size;
+			ok = (std::sscanf(argv[++i], "%ux%u", &board.x, &board.y) == 2 && board.x > 0 && board.y > 0 && uint64_t(board.x) * board.y >= 3);
+		} else if (arg == "--on-demand") {
+			config.on_demand = true;
+		} else if (arg == "--baked-lighting") {
+			config.game.baked_lighting = true;
+		} else if (arg == "--benchmark" && i + 1 < argc) {
+			config.benchmark = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+			ok = (config.benchmark > 0);
+		} else if (arg == "--gl-stats") {
+			config.gl_stats = true;
+		} else if (arg == "--gpu-times") {
+			gpu_timer.enabled = true;
+		} else if (arg == "--render" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "instanced") config.game.render_mode = Game::RenderInstanced;
+			else if (mode == "texture") config.game.render_mode = Game::RenderTexture;
+			else ok = false;
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--seed N] [--board WxH] [--render instanced|texture] [--on-demand] [--baked-lighting] [--gpu-times] [--gl-stats] [--benchmark FRAMES]" << std::endl;
+			return 1;
+		}
+	}
+	//benchmarks replay the same stages unless asked otherwise, so runs can be compared
+	//(which also means not skipping, or recording, the stages this player has seen):
+	if (config.benchmark) {
+		if (!config.seed_given) config.game.seed = 1;
+		config.game.remember_stages = false;
+		config.game.wait_for_stages = true;
+	}
+	std::cout << "Seed: " << config.game.seed << std::endl;
 
 	//------------  initialization ------------
 
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
+	//Ask for an OpenGL context version 3.3, core profile, enable debug (except in release builds):
 	SDL_GL_ResetAttributes();
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -42,7 +260,9 @@ int main(int argc, char **argv) {
 	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	#ifndef NDEBUG
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+	#endif
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
@@ -51,7 +271,8 @@ int main(int argc, char **argv) {
 		config.title.c_str(),
 		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
 		config.size.x, config.size.y,
-		SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI
+		//(benchmarks draw offscreen, so their window stays hidden):
+		config.benchmark ? (SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN) : (SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI)
 	);
 
 	//prevent exceedingly tiny windows when resizing:
@@ -76,8 +297,17 @@ int main(int argc, char **argv) {
 	init_gl_shims();
 	#endif
 
-	//Set VSYNC + Late Swap (prevents crazy FPS):
-	if (SDL_GL_SetSwapInterval(-1) != 0) {
+	#ifndef NDEBUG
+	//have the driver report errors as they happen (otherwise, GL_ERRORS() polls for them):
+	if (!gl_debug_output()) {
+		std::cerr << "NOTE: no debug output (needs GL 4.3 or GL_KHR_debug); checking glGetError instead." << std::endl;
+	}
+	#endif
+
+	//Set VSYNC + Late Swap (prevents crazy FPS), except when benchmarking:
+	if (config.benchmark) {
+		SDL_GL_SetSwapInterval(0);
+	} else if (SDL_GL_SetSwapInterval(-1) != 0) {
 		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
 		if (SDL_GL_SetSwapInterval(1) != 0) {
 			std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
@@ -90,7 +320,15 @@ int main(int argc, char **argv) {
 
 	//------------ create game object (loads assets) --------------
 
-	std::shared_ptr< Game > game = std::make_shared< Game >();
+	std::shared_ptr< Game > game = std::make_shared< Game >(config.game);
+
+	//------------ benchmark (instead of the main loop) ------------
+
+	bool benchmark_ok = true;
+	if (config.benchmark) {
+		benchmark_ok = run_benchmark(*game, config.size, config.benchmark);
+		game.reset(); //(skips the main loop)
+	}
 
 	//------------ main loop ------------
 
@@ -111,28 +349,43 @@ int main(int argc, char **argv) {
 		drawable_size = glm::uvec2(w, h);
 
         //make sure that OpenGL Viewport matches the window size in display pixels:
-		glViewport(0, 0, drawable_size.x, drawable_size.y);
+		gl_state.viewport(0, 0, drawable_size.x, drawable_size.y);
 	};
 	on_resize();
 
+	//in on-demand mode, a frame is only drawn when this is set (or the game is animating):
+	bool redraw = true;
+
 	//This will loop until the game object is set to null:
 	while (game) {
         if (game->game_state == Game::Win) {  //player win, generate new game
             game->generate_new_stage();
+            redraw = true;
         } else {  //go on
             //every pass through the game loop creates one frame of output
             //  by performing three steps:
 
             { //(1) process any events that are pending
                 static SDL_Event evt;
-                while (SDL_PollEvent(&evt) == 1) {
-                    //handle resizing:
+                //in on-demand mode, sleep until there is an event if there is nothing new to draw:
+                bool waited = false;
+                if (config.on_demand && !redraw && !game->animating()) {
+                    if (SDL_WaitEventTimeout(&evt, 1000) == 0) continue; //(timeout just makes sure a missed wakeup can't stall the loop)
+                    waited = true;
+                }
+                while (waited || SDL_PollEvent(&evt) == 1) {
+                    waited = false;
+                    //handle resizing and the window being uncovered:
                     if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
                         on_resize();
+                        redraw = true;
+                    } else if (evt.type == SDL_WINDOWEVENT && (evt.window.event == SDL_WINDOWEVENT_EXPOSED || evt.window.event == SDL_WINDOWEVENT_SHOWN || evt.window.event == SDL_WINDOWEVENT_RESTORED)) {
+                        redraw = true;
                     }
                     //handle input:
                     if (game && game->handle_event(evt, window_size)) {
                         // mode handled it; great
+                        redraw = true;
                     } else if (evt.type == SDL_QUIT) {
                         game.reset(); //done: deallocate game
                         break;
@@ -151,20 +404,28 @@ int main(int argc, char **argv) {
                 //lag to avoid spiral of death:
                 elapsed = std::min(0.1f, elapsed);
 
+                if (game->animating()) redraw = true;
                 game->update(elapsed);
                 if (!game) break;
             }
         }
 
+        //in on-demand mode, skip drawing when the last frame is still up to date:
+        if (config.on_demand && !redraw) continue;
+        redraw = false;
+
         { //(3) call the game's "draw" function to produce output:
-            //clear the depth+color buffers and set some default state:
-            glClearColor(0.5, 0.5, 0.5, 0.0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-            game->draw(drawable_size);
+            draw_frame(*game, drawable_size);
+        }
+
+        //with --gpu-times, print the per-pass GPU times about once a second:
+        if (gpu_timer.enabled) {
+            static auto last_report = std::chrono::high_resolution_clock::now();
+            auto now = std::chrono::high_resolution_clock::now();
+            if (now - last_report >= std::chrono::seconds(1)) {
+                last_report = now;
+                std::cout << gpu_timer.report() << std::endl;
+            }
         }
 
         //Finally, wait until the recently-drawn frame is shown before doing it all again:
@@ -174,11 +435,15 @@ int main(int argc, char **argv) {
 
 	//------------  teardown ------------
 
+	if (config.gl_stats) std::cout << "GL state changes: " << gl_state.issued << " issued, " << gl_state.elided << " skipped as redundant." << std::endl;
+	if (gpu_timer.enabled) std::cout << gpu_timer.report() << std::endl;
+	gpu_timer.release();
+
 	SDL_GL_DeleteContext(context);
 	context = 0;
 
 	SDL_DestroyWindow(window);
 	window = NULL;
 
-	return 0;
+	return benchmark_ok ? 0 : 1;
 }
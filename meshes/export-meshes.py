@@ -28,11 +28,22 @@ bpy.ops.wm.open_mainfile(filepath=infile)
 
 do_texcoord = False
 
-#names of objects whose meshes to write (not actually the names of the meshes):
+#levels of detail: objects with more than lod_min_faces faces are also written decimated to each of
+# these fractions of their face count, named '<name>.lod1', '<name>.lod2', ...
+#(objects already named like '<name>.lodN' are written as-is, so LODs can also be made by hand)
+lod_ratios = [0.25, 0.08, 0.03]
+lod_min_faces = 200
+
+#(object name, name to write, decimate ratio) for each mesh to write (object names, not the names of the meshes):
 to_write = []
+originals = {}
 for obj in bpy.data.objects:
         if obj.type == 'MESH':
-                to_write.append(obj.name)
+                to_write.append((obj.name, obj.name, 1.0))
+                originals[obj.name] = obj.data
+                if '.lod' not in obj.name and len(obj.data.polygons) > lod_min_faces:
+                        for level, ratio in enumerate(lod_ratios):
+                                to_write.append((obj.name, obj.name + '.lod' + str(level + 1), ratio))
 
 #data contains vertex and normal data from the meshes:
 data = b''
@@ -44,13 +55,13 @@ strings = b''
 index = b''
 
 vertex_count = 0
-for name in to_write:
+for (obj_name, name, ratio) in to_write:
         print("Writing '" + name + "'...")
         bpy.ops.object.mode_set(mode='OBJECT') #get out of edit mode (just in case)
-        assert(name in bpy.data.objects)
-        obj = bpy.data.objects[name]
+        assert(obj_name in bpy.data.objects)
+        obj = bpy.data.objects[obj_name]
 
-        obj.data = obj.data.copy() #make mesh single user, just in case it is shared with another object the script needs to write later.
+        obj.data = originals[obj_name].copy() #make mesh single user, just in case it is shared with another object the script needs to write later (and start each LOD from the full mesh).
 
         #make sure object is on a visible layer:
         bpy.context.scene.layers = obj.layers
@@ -59,6 +70,12 @@ for name in to_write:
         obj.select = True
         bpy.context.scene.objects.active = obj
 
+        #reduce the face count for levels of detail:
+        if ratio < 1.0:
+                decimate = obj.modifiers.new(name='lod', type='DECIMATE')
+                decimate.ratio = ratio
+                bpy.ops.object.modifier_apply(apply_as='DATA', modifier=decimate.name)
+
         #subdivide object's mesh into triangles:
         bpy.ops.object.mode_set(mode='EDIT')
         bpy.ops.mesh.select_all(action='SELECT')
@@ -34,3 +34,15 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
+
+//peek_chunk returns true if the next chunk in 'from' has the given magic number, without reading it
+// (so optional chunks can be skipped over by older files):
+inline bool peek_chunk(std::istream &from, std::string const &magic) {
+	assert(magic.length() == 4);
+	char next[4];
+	auto at = from.tellg();
+	bool found = bool(from.read(next, 4)) && std::string(next, 4) == magic;
+	from.clear();
+	from.seekg(at);
+	return found;
+}
@@ -0,0 +1,207 @@
+//stagegen generates, validates and rates large numbers of stages on all cores.
+//Usage:
+//  stagegen <out.stages> [--count N] [--size WxH] [--moves MIN-MAX] [--threads T] [--seed S]
+//Each thread draws from its own stream of one seeded Rng (see Rng::jump), and
+// batches are written in order, so a given seed and thread count always
+// produces the same file.
+//
+//The output is a sequence of chunks in the style of read_chunk.hpp:
+//  "sgh0" : one Header record
+//  "stg0" : Stage records (one chunk per batch, in batch order)
+
+#include "Solver.hpp"
+#include "Rng.hpp"
+#include "write_chunk.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+struct Header {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t min_moves = 0;
+	uint32_t max_moves = 0;
+	uint64_t seed = 0;
+	uint32_t threads = 0;
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(Header) == 32, "Header should be packed.");
+
+struct Stage {
+	uint64_t code = 0; //packed board (see Board::pack)
+	uint64_t hash = 0; //canonical hash (see Solver::canonical_hash)
+	uint32_t moves = 0; //optimal solution length
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(Stage) == 24, "Stage should be packed.");
+
+int main(int argc, char **argv) {
+	std::string outfile;
+	Header header;
+	header.width = 4;
+	header.height = 4;
+	header.min_moves = 1;
+	header.max_moves = 16;
+	header.threads = std::max(1U, std::thread::hardware_concurrency());
+	uint64_t count = 1000000;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc) {
+			if (std::sscanf(argv[++i], "%ux%u", &header.width, &header.height) != 2) {
+				std::cerr << "Expected --size WxH." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--moves" && i + 1 < argc) {
+			if (std::sscanf(argv[++i], "%u-%u", &header.min_moves, &header.max_moves) != 2 || header.min_moves < 1 || header.min_moves > header.max_moves) {
+				std::cerr << "Expected --moves MIN-MAX with 1 <= MIN <= MAX." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			header.threads = std::max(1UL, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--seed" && i + 1 < argc) {
+			header.seed = std::strtoull(argv[++i], nullptr, 10);
+		} else if (outfile.empty() && arg[0] != '-') {
+			outfile = arg;
+		} else {
+			outfile = "";
+			break;
+		}
+	}
+	if (outfile.empty()) {
+		std::cerr << "Usage:\n\tstagegen <out.stages> [--count N] [--size WxH] [--moves MIN-MAX] [--threads T] [--seed S]" << std::endl;
+		return 1;
+	}
+
+	glm::uvec2 size(header.width, header.height);
+	uint32_t cells = size.x * size.y;
+	Solver check(size); //throws here, rather than on a worker thread, if boards of this size can't be rated
+
+	std::ofstream out(outfile, std::ios::binary);
+	write_chunk(out, "sgh0", std::vector< Header >(1, header));
+
+	//thread t fills batches t, t + threads, t + 2*threads, ... from its own stream, and waits for
+	//its turn to append each one to the file as a chunk, so the output doesn't depend on timing:
+	const uint64_t Batch = 16384;
+	//a thread gives up after this many boards in a row without a stage in the --moves range:
+	const uint64_t MaxMisses = 1 << 22;
+	std::atomic< uint64_t > generated(0); //boards drawn, including rejected ones
+	std::atomic< uint64_t > kept(0);
+	std::atomic< uint32_t > running(header.threads);
+	std::atomic< bool > failed(false);
+	std::mutex out_mutex;
+	std::condition_variable out_turn;
+	uint64_t next_batch = 0; //index of the batch to write next (guarded by out_mutex)
+
+	auto give_up = [&]() {
+		std::lock_guard< std::mutex > lock(out_mutex);
+		failed = true;
+		out_turn.notify_all();
+	};
+
+	auto work = [&](uint32_t thread, Rng rng) {
+		Solver solver(size);
+		std::vector< Stage > stages;
+		stages.reserve(Batch);
+		uint64_t misses = 0;
+		for (uint64_t begin = thread * Batch; begin < count && !failed; begin += header.threads * Batch) {
+			uint64_t want = std::min(Batch, count - begin);
+
+			stages.clear();
+			uint64_t drawn = 0;
+			while (stages.size() < want) {
+				if (misses >= MaxMisses || failed) {
+					give_up();
+					break;
+				}
+				Stage stage;
+				stage.code = rng.ternary_packed(cells);
+				++misses;
+				//(counted in groups, so the progress rate moves even while a batch is slow to fill)
+				if (++drawn == 1024) {
+					generated += drawn;
+					drawn = 0;
+				}
+				//valid stages have a piece of each color and aren't already won:
+				if (Solver::count(stage.code, Board::Black) < 1 || Solver::count(stage.code, Board::White) < 1) continue;
+				int32_t moves = solver.solve(stage.code, header.max_moves);
+				if (moves < int32_t(header.min_moves)) continue; //also rejects Unsolvable
+				stage.moves = uint32_t(moves);
+				stage.hash = solver.canonical_hash(stage.code);
+				stages.emplace_back(stage);
+				misses = 0;
+			}
+			generated += drawn;
+			if (failed) break;
+
+			{ //wait for the previous batch to be written, then write this one:
+				std::unique_lock< std::mutex > lock(out_mutex);
+				uint64_t index = begin / Batch;
+				out_turn.wait(lock, [&]() { return next_batch == index || failed; });
+				if (failed) break;
+				write_chunk(out, "stg0", stages);
+				++next_batch;
+				out_turn.notify_all();
+			}
+			kept += stages.size();
+		}
+		--running;
+	};
+
+	std::cout << "Generating " << count << " " << size.x << "x" << size.y << " stages with " << header.min_moves << "-" << header.max_moves << " moves on " << header.threads << " threads..." << std::endl;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector< std::thread > threads;
+	{ //every thread gets the next non-overlapping stream of one generator:
+		Rng rng(header.seed);
+		for (uint32_t t = 0; t < header.threads; ++t) {
+			threads.emplace_back(work, t, rng);
+			rng.jump();
+		}
+	}
+
+	//report progress about once a second until the threads are done:
+	auto report = [&]() {
+		float elapsed = std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - start).count();
+		uint64_t k = kept, g = generated;
+		std::cout << "\r  " << k << " / " << count << " stages, " << uint64_t(k / elapsed) << " stages/s (" << uint64_t(g / elapsed) << " boards/s rated or rejected)   " << std::flush;
+	};
+	auto last = start;
+	while (running > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		auto now = std::chrono::high_resolution_clock::now();
+		if (now - last >= std::chrono::seconds(1)) {
+			last = now;
+			report();
+		}
+	}
+	for (auto &t : threads) {
+		t.join();
+	}
+	report();
+	std::cout << std::endl;
+
+	if (failed) {
+		std::cerr << "Gave up after " << MaxMisses << " boards in a row without a stage of " << header.min_moves << "-" << header.max_moves << " moves; is that range possible on " << size.x << "x" << size.y << " boards?" << std::endl;
+		return 1;
+	}
+	if (!out) {
+		std::cerr << "Failed to write '" << outfile << "'." << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << out.tellp() << " bytes to '" << outfile << "'." << std::endl;
+
+	return 0;
+}
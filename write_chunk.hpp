@@ -0,0 +1,37 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+
+//write_chunk writes a vector of structures prefixed by a magic number and byte count;
+// it is the counterpart of read_chunk in read_chunk.hpp.
+template< typename T >
+void write_chunk(std::ostream &to, std::string const &magic, std::vector< T > const &from) {
+	assert(magic.length() == 4);
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (from.size() * sizeof(T) > 0xffffffffULL) {
+		throw std::runtime_error("Chunk too large to write");
+	}
+
+	ChunkHeader header;
+	header.magic[0] = magic[0];
+	header.magic[1] = magic[1];
+	header.magic[2] = magic[2];
+	header.magic[3] = magic[3];
+	header.size = uint32_t(from.size() * sizeof(T));
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(from.data()), from.size() * sizeof(T));
+	if (!to) {
+		throw std::runtime_error("Failed to write chunk.");
+	}
+}